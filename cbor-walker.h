@@ -4,6 +4,10 @@
 #include <cstdint>
 #include <cmath>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
+#include <type_traits>
+#include <limits>
 #ifndef UINT64_MAX
 #	define UINT64_MAX 0xFFFFFFFFFFFFFFFFull;
 #endif
@@ -19,9 +23,412 @@
 #	include <bit>
 #endif
 #include <ostream>
+// `CborRecords::forEachParallel()` uses `std::thread`
+#ifndef CBOR_WALKER_NO_THREADS
+#	include <thread>
+#	include <atomic>
+#endif
+// `CborMappedFile` is opt-in (define `CBOR_WALKER_MAPPED_FILE`) since it needs platform headers: it uses POSIX `mmap()` where it's available, and otherwise reads the whole file
+#ifdef CBOR_WALKER_MAPPED_FILE
+#	if !defined(CBOR_WALKER_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#		define CBOR_WALKER_MMAP
+#		include <sys/mman.h>
+#		include <sys/stat.h>
+#		include <fcntl.h>
+#		include <unistd.h>
+#		include <cerrno>
+#	else
+#		include <fstream>
+#		include <iterator>
+#		include <cerrno>
+#	endif
+#endif
+
+// Maximum nesting depth when skipping over containers (deeper values produce `ERROR_TOO_DEEP`)
+#ifndef CBOR_WALKER_MAX_DEPTH
+#	define CBOR_WALKER_MAX_DEPTH 128
+#endif
+
+// Byte-swapping and half-float kernels for typed arrays use SIMD where it's available at compile-time
+#ifndef CBOR_WALKER_NO_SIMD
+#	if defined(__AVX2__)
+#		define CBOR_WALKER_AVX2
+#		include <immintrin.h>
+#	endif
+#	if defined(__F16C__)
+#		define CBOR_WALKER_F16C
+#		include <immintrin.h>
+#	endif
+#	if defined(__SSSE3__)
+#		define CBOR_WALKER_SSSE3
+#		include <tmmintrin.h>
+#	elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#		define CBOR_WALKER_NEON
+#		include <arm_neon.h>
+#	endif
+#endif
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+#	if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#		define CBOR_WALKER_LITTLE_ENDIAN
+#	endif
+#elif defined(_MSC_VER)
+#	define CBOR_WALKER_LITTLE_ENDIAN
+#endif
 
 namespace signalsmith { namespace cbor {
 
+// Byte-swapping and unaligned big/little-endian loads/stores, each a single `memcpy()`
+struct ByteOrder {
+	// Unsigned int with the same size as `T`
+	template<typename T>
+	using UIntFor = typename std::conditional<sizeof(T) == 1, uint8_t,
+		typename std::conditional<sizeof(T) == 2, uint16_t,
+			typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type
+		>::type
+	>::type;
+
+	static uint8_t swap(uint8_t v) {
+		return v;
+	}
+	static uint16_t swap(uint16_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_bswap16(v);
+#else
+		return uint16_t((v>>8)|(v<<8));
+#endif
+	}
+	static uint32_t swap(uint32_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_bswap32(v);
+#else
+		return (v>>24)|((v>>8)&0xFF00)|((v<<8)&0xFF0000)|(v<<24);
+#endif
+	}
+	static uint64_t swap(uint64_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_bswap64(v);
+#else
+		return (uint64_t(swap(uint32_t(v)))<<32)|swap(uint32_t(v>>32));
+#endif
+	}
+
+	template<typename UInt>
+	static UInt fromBig(UInt v) {
+#ifdef CBOR_WALKER_LITTLE_ENDIAN
+		return swap(v);
+#else
+		return v;
+#endif
+	}
+	template<typename UInt>
+	static UInt fromLittle(UInt v) {
+#ifdef CBOR_WALKER_LITTLE_ENDIAN
+		return v;
+#else
+		return swap(v);
+#endif
+	}
+
+	template<typename UInt>
+	static UInt loadBig(const unsigned char *bytes) {
+		UInt v;
+		std::memcpy(&v, bytes, sizeof(UInt));
+		return fromBig(v);
+	}
+	template<typename UInt>
+	static void storeBig(unsigned char *bytes, UInt v) {
+		v = fromBig(v);
+		std::memcpy(bytes, &v, sizeof(UInt));
+	}
+	template<typename UInt>
+	static UInt loadLittle(const unsigned char *bytes) {
+		UInt v;
+		std::memcpy(&v, bytes, sizeof(UInt));
+		return fromLittle(v);
+	}
+	template<typename UInt>
+	static void storeLittle(unsigned char *bytes, UInt v) {
+		v = fromLittle(v);
+		std::memcpy(bytes, &v, sizeof(UInt));
+	}
+
+	// Copies `count` elements between native order and big/little-endian bytes (the same operation in either direction)
+	template<typename UInt>
+	static void copyBig(void *output, const void *input, size_t count) {
+#ifdef CBOR_WALKER_LITTLE_ENDIAN
+		copySwapped<UInt>((unsigned char *)output, (const unsigned char *)input, count);
+#else
+		std::memcpy(output, input, count*sizeof(UInt));
+#endif
+	}
+	template<typename UInt>
+	static void copyLittle(void *output, const void *input, size_t count) {
+#ifdef CBOR_WALKER_LITTLE_ENDIAN
+		std::memcpy(output, input, count*sizeof(UInt));
+#else
+		copySwapped<UInt>((unsigned char *)output, (const unsigned char *)input, count);
+#endif
+	}
+
+	// Copies `count` elements, reversing the byte order of each one
+	template<typename UInt>
+	static void copySwapped(unsigned char *output, const unsigned char *input, size_t count) {
+		constexpr size_t B = sizeof(UInt);
+		size_t i = 0;
+		if (B > 1) {
+#if defined(CBOR_WALKER_SSSE3) || defined(CBOR_WALKER_AVX2)
+			// Shuffle which reverses each B-byte group
+			alignas(16) unsigned char order[16];
+			for (size_t j = 0; j < 16; ++j) order[j] = (unsigned char)((j/B)*B + (B - 1 - j%B));
+			__m128i shuffle = _mm_load_si128((const __m128i *)order);
+#endif
+#ifdef CBOR_WALKER_AVX2
+			__m256i shuffle256 = _mm256_broadcastsi128_si256(shuffle);
+			for (; i + 32/B <= count; i += 32/B) {
+				__m256i v = _mm256_loadu_si256((const __m256i *)(input + i*B));
+				_mm256_storeu_si256((__m256i *)(output + i*B), _mm256_shuffle_epi8(v, shuffle256));
+			}
+#endif
+#ifdef CBOR_WALKER_SSSE3
+			for (; i + 16/B <= count; i += 16/B) {
+				__m128i v = _mm_loadu_si128((const __m128i *)(input + i*B));
+				_mm_storeu_si128((__m128i *)(output + i*B), _mm_shuffle_epi8(v, shuffle));
+			}
+#elif defined(CBOR_WALKER_NEON)
+			for (; i + 16/B <= count; i += 16/B) {
+				uint8x16_t v = vld1q_u8(input + i*B);
+				v = (B == 2) ? vrev16q_u8(v) : (B == 4) ? vrev32q_u8(v) : vrev64q_u8(v);
+				vst1q_u8(output + i*B, v);
+			}
+#endif
+		}
+		for (; i < count; ++i) {
+			UInt v;
+			std::memcpy(&v, input + i*B, B);
+			v = swap(v);
+			std::memcpy(output + i*B, &v, B);
+		}
+	}
+};
+
+// IEEE half-precision (and bfloat16) conversions, rounding to nearest-even
+struct Float16 {
+	static float toFloat(uint16_t half) {
+		uint32_t sign = uint32_t(half&0x8000)<<16;
+		uint32_t expMantissa = half&0x7FFF;
+		uint32_t bits;
+		if (expMantissa >= 0x7C00) { // Inf/NaN
+			bits = 0x7F800000|((expMantissa&0x03FF)<<13);
+		} else if (expMantissa >= 0x0400) { // normal: re-bias the exponent
+			bits = (expMantissa<<13) + ((127 - 15)<<23);
+		} else { // subnormal: exact in float
+			float f = float(expMantissa)*5.9604644775390625e-8f; // 2^-24
+			std::memcpy(&bits, &f, 4);
+		}
+		bits |= sign;
+		float result;
+		std::memcpy(&result, &bits, 4);
+		return result;
+	}
+	static uint16_t fromFloat(float value) {
+		uint32_t x;
+		std::memcpy(&x, &value, 4);
+		uint16_t sign = (x>>16)&0x8000;
+		x &= 0x7FFFFFFF;
+		uint16_t result;
+		if (x >= 0x47800000) { // too big (or Inf/NaN)
+			result = (x > 0x7F800000) ? 0x7E00 : 0x7C00;
+		} else if (x < 0x38800000) { // subnormal: let float addition do the rounding
+			float f;
+			std::memcpy(&f, &x, 4);
+			f += 0.5f;
+			std::memcpy(&x, &f, 4);
+			result = uint16_t(x - 0x3F000000);
+		} else {
+			uint32_t mantissaOdd = (x>>13)&1;
+			x -= uint32_t(127 - 15)<<23;
+			x += 0x0FFF + mantissaOdd;
+			result = uint16_t(x>>13);
+		}
+		return result|sign;
+	}
+	// Rounds directly from double (avoiding double-rounding through float)
+	static uint16_t fromDouble(double value) {
+		uint64_t x;
+		std::memcpy(&x, &value, 8);
+		uint16_t sign = (x>>48)&0x8000;
+		x &= 0x7FFFFFFFFFFFFFFFull;
+		uint16_t result;
+		if (x >= 0x40F0000000000000ull) { // too big (or Inf/NaN)
+			result = (x > 0x7FF0000000000000ull) ? 0x7E00 : 0x7C00;
+		} else if (x < 0x3F10000000000000ull) { // subnormal: add 2^28, whose ULP is 2^-24
+			double d;
+			std::memcpy(&d, &x, 8);
+			d += 268435456.0;
+			std::memcpy(&x, &d, 8);
+			result = uint16_t(x - 0x41B0000000000000ull);
+		} else {
+			uint64_t mantissaOdd = (x>>42)&1;
+			x -= uint64_t(1023 - 15)<<52;
+			x += 0x1FFFFFFFFFFull + mantissaOdd;
+			result = uint16_t(x>>42);
+		}
+		return result|sign;
+	}
+
+	// bfloat16 is the top half of a float32 (there's no RFC-8746 tag for it, so this is only for conversion)
+	static float bfloat16ToFloat(uint16_t bfloat) {
+		uint32_t bits = uint32_t(bfloat)<<16;
+		float result;
+		std::memcpy(&result, &bits, 4);
+		return result;
+	}
+	static uint16_t bfloat16FromFloat(float value) {
+		uint32_t x;
+		std::memcpy(&x, &value, 4);
+		if ((x&0x7FFFFFFF) > 0x7F800000) return uint16_t((x>>16)|0x0040); // keep NaNs quiet
+		x += 0x7FFF + ((x>>16)&1);
+		return uint16_t(x>>16);
+	}
+
+	// Array conversions (native-order halves)
+	static void toFloats(const uint16_t *halves, float *output, size_t count) {
+		size_t i = 0;
+#ifdef CBOR_WALKER_F16C
+		for (; i + 8 <= count; i += 8) {
+			__m128i h = _mm_loadu_si128((const __m128i *)(halves + i));
+			_mm256_storeu_ps(output + i, _mm256_cvtph_ps(h));
+		}
+#elif defined(CBOR_WALKER_NEON) && defined(__aarch64__)
+		for (; i + 4 <= count; i += 4) {
+			float16x4_t h = vreinterpret_f16_u16(vld1_u16(halves + i));
+			vst1q_f32(output + i, vcvt_f32_f16(h));
+		}
+#endif
+		for (; i < count; ++i) output[i] = toFloat(halves[i]);
+	}
+	static void fromFloats(const float *input, uint16_t *halves, size_t count) {
+		size_t i = 0;
+#ifdef CBOR_WALKER_F16C
+		for (; i + 8 <= count; i += 8) {
+			__m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(input + i), _MM_FROUND_TO_NEAREST_INT);
+			_mm_storeu_si128((__m128i *)(halves + i), h);
+		}
+#elif defined(CBOR_WALKER_NEON) && defined(__aarch64__)
+		for (; i + 4 <= count; i += 4) {
+			float16x4_t h = vcvt_f16_f32(vld1q_f32(input + i));
+			vst1_u16(halves + i, vreinterpret_u16_f16(h));
+		}
+#endif
+		for (; i < count; ++i) halves[i] = fromFloat(input[i]);
+	}
+
+	// Checks the bits of a float/double to see if it's exactly representable with a narrower exponent/mantissa, and if so fills `result`
+	template<int ExpBits, int MantissaBits, typename UInt>
+	static bool narrowFloat(UInt bits, uint64_t &result) {
+		constexpr int fromMantissaBits = (sizeof(UInt) == 8) ? 52 : 23, fromExpBits = (sizeof(UInt) == 8) ? 11 : 8;
+		constexpr int fromBias = (1<<(fromExpBits - 1)) - 1, bias = (1<<(ExpBits - 1)) - 1;
+		constexpr int dropBits = fromMantissaBits - MantissaBits;
+		int exponent = int(bits>>fromMantissaBits)&((1<<fromExpBits) - 1);
+		UInt mantissa = bits&((UInt(1)<<fromMantissaBits) - 1);
+		uint64_t sign = uint64_t(bits>>(fromExpBits + fromMantissaBits))<<(ExpBits + MantissaBits);
+		int shift = dropBits;
+		if (exponent == (1<<fromExpBits) - 1) { // Inf/NaN (keeping the top of the payload)
+			result = sign|(uint64_t((1<<ExpBits) - 1)<<MantissaBits)|uint64_t(mantissa>>shift);
+		} else if (exponent == 0) { // zero - subnormals are always too small for the narrower format
+			result = sign;
+			return !mantissa;
+		} else {
+			int e = exponent - fromBias;
+			if (e > bias) return false;
+			if (e >= 1 - bias) {
+				result = sign|(uint64_t(e + bias)<<MantissaBits)|uint64_t(mantissa>>shift);
+			} else { // subnormal in the narrower format
+				shift += 1 - bias - e;
+				if (shift > fromMantissaBits) return false;
+				mantissa |= UInt(1)<<fromMantissaBits;
+				result = sign|uint64_t(mantissa>>shift);
+			}
+		}
+		return !(mantissa&((UInt(1)<<shift) - 1));
+	}
+};
+
+// Side-table of container end positions, so that repeated `.next()` calls on the same array/map/etc. are constant-time jumps.
+// Attach it with `CborWalker::withSkipIndex()` - it's filled in lazily as containers are walked, so calling `.next()` once on the root fills in all nested containers as well.
+// Keys are pointers, so only use an index with one buffer (or call `.clear()` between buffers).
+struct CborSkipIndex {
+	CborSkipIndex(size_t minBytes=16) : minBytes(minBytes) {}
+
+	// Containers which are shorter than this aren't recorded (since they're quick to walk anyway)
+	size_t minBytes;
+
+	void clear() {
+		ends.clear();
+		exits.clear();
+	}
+	size_t size() const {
+		return ends.size() + exits.size();
+	}
+
+private:
+	friend struct CborWalker;
+
+	// Open-addressing hash table from start -> end positions
+	struct PointerMap {
+		const unsigned char * find(const unsigned char *key) const {
+			if (!count) return nullptr;
+			size_t mask = entries.size() - 1;
+			for (size_t i = hash(key)&mask; entries[i].key; i = (i + 1)&mask) {
+				if (entries[i].key == key) return entries[i].value;
+			}
+			return nullptr;
+		}
+		void insert(const unsigned char *key, const unsigned char *value) {
+			if ((count + 1)*2 > entries.size()) grow();
+			size_t mask = entries.size() - 1;
+			size_t i = hash(key)&mask;
+			while (entries[i].key && entries[i].key != key) i = (i + 1)&mask;
+			if (!entries[i].key) ++count;
+			entries[i] = {key, value};
+		}
+		void clear() {
+			entries.clear();
+			count = 0;
+		}
+		size_t size() const {
+			return count;
+		}
+	private:
+		struct Entry {
+			const unsigned char *key, *value;
+		};
+		std::vector<Entry> entries;
+		size_t count = 0;
+
+		static size_t hash(const unsigned char *key) {
+			uint64_t h = (uint64_t)(uintptr_t)key*0x9E3779B97F4A7C15ull;
+			return (size_t)(h ^ (h>>32));
+		}
+		void grow() {
+			std::vector<Entry> old;
+			old.swap(entries);
+			entries.assign(old.size() ? old.size()*2 : 64, Entry{nullptr, nullptr});
+			count = 0;
+			for (auto &e : old) {
+				if (e.key) insert(e.key, e.value);
+			}
+		}
+	};
+	// Ends of containers (keyed by the container's head)
+	PointerMap ends;
+	// Results of `.nextExit()` (keyed by the starting position)
+	PointerMap exits;
+};
+
+struct CborStringRefs;
+
 struct CborWalker {
 	CborWalker(uint64_t errorCode=ERROR_NOT_INITIALISED) : CborWalker(nullptr, nullptr, errorCode) {}
 	CborWalker(const std::vector<unsigned char> &vector) : CborWalker(vector.data(), vector.size()) {}
@@ -30,11 +437,21 @@ struct CborWalker {
 		if (data >= dataEnd) {
 			typeCode = TypeCode::error;
 			additional = ERROR_END_OF_DATA;
+			dataNext = data;
 			return;
 		}
 		unsigned char head = *data;
 		typeCode = (TypeCode)(head>>5);
 		unsigned char remainder = head&0x1F;
+#ifndef CBOR_WALKER_UNCHECKED
+		// Heads are at most 9 bytes, so we only need to check the argument fits when we're near the end
+		if (dataEnd - data < 9 && remainder >= 24 && remainder < 28 && dataEnd - data <= (1<<(remainder - 24))) {
+			typeCode = TypeCode::error;
+			additional = ERROR_END_OF_DATA;
+			dataNext = data;
+			return;
+		}
+#endif
 		switch (remainder) {
 		case 24:
 			additional = data[1];
@@ -42,24 +459,8 @@ struct CborWalker {
 			break;
 		case 25:
 			if (typeCode == TypeCode::simple) {
-#ifdef CBOR_WALKER_HALF_PRECISION_FLOAT
-				// Translated from RFC 8949 Appendix D
-				uint16_t half = ((uint16_t)data[1]<<8) + data[2];
-				uint16_t exponent = (half>>10)&0x001F;
-				uint16_t mantissa = half&0x03FF;
-				double value;
-				if (exponent == 0) {
-					value = std::ldexpf(mantissa, -24);
-				} else if (exponent == 31) {
-					value = (mantissa == 0) ? INFINITY : NAN;
-				} else {
-					value = std::ldexpf(mantissa + 1024, exponent - 25);
-				}
 				typeCode = TypeCode::float32;
-				float32 = (half&0x8000) ? -value : value;
-#else
-				float32 = 0;
-#endif
+				float32 = Float16::toFloat((uint16_t(data[1])<<8)|data[2]);
 			} else {
 				additional = (uint64_t(data[1])<<8)|uint64_t(data[2]);
 			}
@@ -85,6 +486,7 @@ struct CborWalker {
 			typeCode = TypeCode::error;
 			additional = ERROR_INVALID_ADDITIONAL;
 			dataNext = data;
+			break;
 		case 31:
 			additional = 0; // returns 0 length for indefinite values
 			switch (typeCode) {
@@ -114,11 +516,21 @@ struct CborWalker {
 				additional = ERROR_SHOULD_BE_IMPOSSIBLE;
 				break;
 			}
+			dataNext = data + 1;
+			break;
 		default:
 			additional = remainder;
 			dataNext = data + 1;
 			break;
 		}
+#ifndef CBOR_WALKER_UNCHECKED
+		// Truncated strings are an error, so `.bytes()`/`.utf8()`/`.next()` never go past the end
+		if ((typeCode == TypeCode::bytes || typeCode == TypeCode::utf8) && additional > (uint64_t)(dataEnd - dataNext)) {
+			typeCode = TypeCode::error;
+			additional = ERROR_END_OF_DATA;
+			dataNext = data;
+		}
+#endif
 	}
 	
 	// All error codes are non-zero, so can be checked with `.error()`
@@ -129,6 +541,11 @@ struct CborWalker {
 	static constexpr uint64_t ERROR_NOT_INITIALISED = 5;
 	static constexpr uint64_t ERROR_METHOD_TYPE_MISMATCH = 6;
 	static constexpr uint64_t ERROR_SHOULD_BE_IMPOSSIBLE = 7;
+	static constexpr uint64_t ERROR_NOT_FOUND = 8;
+	static constexpr uint64_t ERROR_TOO_DEEP = 9;
+	static constexpr uint64_t ERROR_TOO_MANY_ITEMS = 10;
+	static constexpr uint64_t ERROR_TRAILING_DATA = 11;
+	static constexpr uint64_t ERROR_TOO_LARGE = 12;
 
 	CborWalker next(size_t count) const {
 		CborWalker result = *this;
@@ -148,70 +565,149 @@ struct CborWalker {
 			return nextBasic();
 		case TypeCode::bytes:
 		case TypeCode::utf8:
-			return {dataNext + additional, dataEnd};
-			return {dataNext + additional, dataEnd};
-		case TypeCode::array: {
-			auto result = nextBasic();
-			auto length = additional;
-			for (uint64_t i = 0; i < length; ++i) {
-				++result;
-			}
-			return result;
+			return walkerAt(dataNext + additional);
+		case TypeCode::error:
+			return *this;
+		default:
+			return skipContainer();
 		}
-		case TypeCode::map: {
-			auto result = nextBasic();
-			auto length = additional;
-			for (uint64_t i = 0; i < length; ++i) {
-				++result;
-				++result;
-			}
-			return result;
+	}
+
+	// Returns a copy which uses (and fills in) the skip index - this is inherited by any walkers derived from it
+	CborWalker withSkipIndex(CborSkipIndex &index) const {
+		CborWalker result = *this;
+		result.skipIndex = &index;
+		return result;
+	}
+	CborWalker withoutSkipIndex() const {
+		CborWalker result = *this;
+		result.skipIndex = nullptr;
+		return result;
+	}
+	CborSkipIndex * getSkipIndex() const {
+		return skipIndex;
+	}
+
+	// Returns a copy which resolves stringrefs (tag 25) using the table - like the skip index, this is inherited by derived walkers
+	CborWalker withStringRefs(CborStringRefs &refs) const {
+		CborWalker result = *this;
+		result.stringRefs = &refs;
+		return result;
+	}
+	CborStringRefs * getStringRefs() const {
+		return stringRefs;
+	}
+	// If this is a stringref (tag 25) which the attached `CborStringRefs` knows about, returns the string it refers to (otherwise returns itself)
+	CborWalker resolveStringRef() const;
+
+private:
+	bool hasChildren() const {
+		switch (typeCode) {
+		case TypeCode::array:
+		case TypeCode::map:
+		case TypeCode::tag:
+		case TypeCode::indefiniteBytes:
+		case TypeCode::indefiniteUtf8:
+		case TypeCode::indefiniteArray:
+		case TypeCode::indefiniteMap:
+			return true;
+		default:
+			return false;
 		}
-		case TypeCode::indefiniteBytes: {
-			auto result = nextBasic();
-			while (!result.error() && result.typeCode != TypeCode::indefiniteBreak) {
-				if (result.typeCode != TypeCode::bytes) {
-					return {data, dataEnd, ERROR_INCONSISTENT_INDEFINITE};
+	}
+
+	// Skips an array/map/tag/indefinite string without recursion, using a fixed-size stack
+	CborWalker skipContainer() const {
+		struct Level {
+			const unsigned char *start;
+			uint64_t remaining;
+			TypeCode chunkType; // indefinite strings can only contain definite strings of the same type
+			bool indefinite, pairs, oddItems;
+		};
+		Level stack[CBOR_WALKER_MAX_DEPTH];
+		size_t depth = 0;
+
+		CborWalker item = *this;
+		while (true) {
+			if (item.error()) return item;
+			const unsigned char *end;
+			if (item.typeCode == TypeCode::indefiniteBreak) {
+				if (!depth || !stack[depth - 1].indefinite || stack[depth - 1].oddItems) return {item.data, dataEnd, ERROR_INVALID_VALUE};
+				end = item.dataNext;
+				--depth;
+				recordEnd(stack[depth].start, end);
+			} else if (depth && stack[depth - 1].chunkType != TypeCode::error && item.typeCode != stack[depth - 1].chunkType) {
+				return {data, dataEnd, ERROR_INCONSISTENT_INDEFINITE};
+			} else if (item.hasChildren()) {
+				const unsigned char *knownEnd = skipIndex ? skipIndex->ends.find(item.data) : nullptr;
+				if (knownEnd && knownEnd <= dataEnd) {
+					end = knownEnd;
+				} else {
+					if (depth >= CBOR_WALKER_MAX_DEPTH) return {data, dataEnd, ERROR_TOO_DEEP};
+					Level &level = stack[depth++];
+					level.start = item.data;
+					level.remaining = item.additional;
+					level.chunkType = TypeCode::error;
+					level.indefinite = level.pairs = level.oddItems = false;
+					switch (item.typeCode) {
+					case TypeCode::map:
+						if (item.additional > (~uint64_t(0))/2) return {item.data, dataEnd, ERROR_END_OF_DATA};
+						level.remaining = item.additional*2;
+						break;
+					case TypeCode::tag:
+						level.remaining = 1;
+						break;
+					case TypeCode::indefiniteBytes:
+						level.chunkType = TypeCode::bytes;
+						level.indefinite = true;
+						break;
+					case TypeCode::indefiniteUtf8:
+						level.chunkType = TypeCode::utf8;
+						level.indefinite = true;
+						break;
+					case TypeCode::indefiniteArray:
+						level.indefinite = true;
+						break;
+					case TypeCode::indefiniteMap:
+						level.indefinite = level.pairs = true;
+						break;
+					default:
+						break;
+					}
+					if (level.indefinite || level.remaining) {
+						item = item.nextBasic();
+						continue;
+					}
+					// Empty array/map
+					--depth;
+					end = item.dataNext;
 				}
-				++result;
+			} else {
+				end = item.isBytes() || item.isUtf8() ? item.dataNext + item.additional : item.dataNext;
 			}
-			return result.nextBasic();
-		}
-		case TypeCode::indefiniteUtf8: {
-			auto result = nextBasic();
-			while (!result.error() && result.typeCode != TypeCode::indefiniteBreak) {
-				if (result.typeCode != TypeCode::utf8) {
-					return {data, dataEnd, ERROR_INCONSISTENT_INDEFINITE};
+			
+			// An item has finished - update the enclosing containers
+			while (depth) {
+				Level &level = stack[depth - 1];
+				if (level.indefinite) {
+					level.oddItems = level.pairs && !level.oddItems;
+					break;
 				}
-				++result;
-			}
-			return result.nextBasic();
-		}
-		case TypeCode::indefiniteArray: {
-			auto result = nextBasic();
-			while (!result.error() && result.typeCode != TypeCode::indefiniteBreak) {
-				result = result.next();
-			}
-			return result.nextBasic();
-		}
-		case TypeCode::indefiniteMap: {
-			auto result = nextBasic();
-			while (!result.error() && result.typeCode != TypeCode::indefiniteBreak) {
-				++result;
-				++result;
+				if (--level.remaining) break;
+				--depth;
+				recordEnd(level.start, end);
 			}
-			return result.nextBasic();
-		}
-		case TypeCode::tag: {
-			// Skip all the tags first
-			auto result = nextBasic();
-			while (result.isTagged()) result = nextBasic();
-			return result.next();
+			if (!depth) return walkerAt(end);
+			item = walkerAt(end);
 		}
-		case TypeCode::error:
-			return *this;
+	}
+	
+	void recordEnd(const unsigned char *start, const unsigned char *end) const {
+		if (skipIndex && (size_t)(end - start) >= skipIndex->minBytes) {
+			skipIndex->ends.insert(start, end);
 		}
 	}
+public:
 
 	// ++Prefix increments the position, and returns itself
 	CborWalker & operator++() {
@@ -251,11 +747,21 @@ struct CborWalker {
 	}
 
 	CborWalker nextExit() const {
+		if (skipIndex) {
+			if (auto *end = skipIndex->exits.find(data)) {
+				if (end <= dataEnd) return walkerAt(end);
+			}
+		}
 		CborWalker result = *this;
 		while (!result.error() && !result.isExit()) {
 			++result;
 		}
-		return result.nextBasic();
+		if (result.error()) return result;
+		result = result.nextBasic();
+		if (skipIndex && (!result.error() || result.atEnd()) && (size_t)(result.data - data) >= skipIndex->minBytes) {
+			skipIndex->exits.insert(data, result.data);
+		}
+		return result;
 	}
 
 	uint64_t error() const {
@@ -296,6 +802,9 @@ struct CborWalker {
 	bool isInt() const {
 		return typeCode == TypeCode::integerP || typeCode == TypeCode::integerN;
 	}
+	bool isNegativeInt() const {
+		return typeCode == TypeCode::integerN;
+	}
 	operator uint64_t() const {
 		switch (typeCode) {
 			case TypeCode::integerP:
@@ -348,7 +857,9 @@ struct CborWalker {
 	operator uint8_t() const {
 		return (uint32_t)(uint64_t)(*this);
 	}
-	operator size_t() const {
+	// Only a separate overload where `size_t` isn't the same type as `uint64_t`
+	template<typename T, typename=typename std::enable_if<std::is_same<T, size_t>::value && !std::is_same<T, uint64_t>::value>::type>
+	operator T() const {
 		return (size_t)(uint64_t)(*this);
 	}
 	// For the signed ones, we cast from the signed 64-bit
@@ -399,6 +910,10 @@ struct CborWalker {
 	const unsigned char * bytes() const {
 		return dataNext;
 	}
+	// Start of the item's encoding (its head), or the end of the data when `.atEnd()`
+	const unsigned char * itemStart() const {
+		return data;
+	}
 
 	std::string utf8() const {
 		if (typeCode != TypeCode::utf8) return "";
@@ -505,6 +1020,38 @@ struct CborWalker {
 		return {data, dataEnd, ERROR_METHOD_TYPE_MISMATCH};
 	}
 	
+	// Finds the value for a map key (UTF-8 or integer), or returns an `ERROR_NOT_FOUND` error.  This is linear in the map size - for repeated lookups, use a `CborMapIndex`
+	CborWalker find(const char *key, size_t keyLength) const {
+		return findKey([&](const CborWalker &k){
+			return k.matchesUtf8(key, keyLength);
+		});
+	}
+	CborWalker find(const char *key) const {
+		return find(key, std::strlen(key));
+	}
+	CborWalker find(const std::string &key) const {
+		return find(key.data(), key.size());
+	}
+#ifdef CBOR_WALKER_USE_STRING_VIEW
+	CborWalker find(const std::string_view &key) const {
+		return find(key.data(), key.size());
+	}
+#endif
+	template<typename Int>
+	typename std::enable_if<std::is_integral<Int>::value, CborWalker>::type find(Int key) const {
+		bool negative = (key < 0);
+		uint64_t magnitude = negative ? (uint64_t)(-1 - (int64_t)key) : (uint64_t)key;
+		return findKey([&](const CborWalker &k){
+			return k.matchesInt(negative, magnitude);
+		});
+	}
+	CborWalker operator[](const char *key) const {
+		return find(key);
+	}
+	CborWalker operator[](const std::string &key) const {
+		return find(key);
+	}
+
 	bool isEnd() const {
 		return typeCode == TypeCode::array || typeCode == TypeCode::indefiniteArray;
 	}
@@ -518,9 +1065,52 @@ protected:
 
 	// The next *core* value - but doesn't check whether the current value is the header for a string/array/etc.
 	CborWalker nextBasic() const {
-		return {dataNext, dataEnd};
+		return walkerAt(dataNext);
+	}
+	// A new walker in the same buffer (keeping the skip index and stringrefs)
+	CborWalker walkerAt(const unsigned char *position) const {
+		CborWalker result{position, dataEnd};
+		result.skipIndex = skipIndex;
+		result.stringRefs = stringRefs;
+		return result;
+	}
+
+	bool matchesUtf8(const char *key, size_t keyLength) const {
+		if (typeCode == TypeCode::tag && stringRefs) {
+			CborWalker string = resolveStringRef();
+			return string.typeCode == TypeCode::utf8 && string.additional == keyLength && !std::memcmp(string.dataNext, key, keyLength);
+		}
+		return typeCode == TypeCode::utf8 && additional == keyLength && !std::memcmp(dataNext, key, keyLength);
+	}
+	bool matchesInt(bool negative, uint64_t magnitude) const {
+		return typeCode == (negative ? TypeCode::integerN : TypeCode::integerP) && additional == magnitude;
 	}
 
+	template<class Match>
+	CborWalker findKey(Match &&match) const {
+		if (!isMap()) return {data, dataEnd, ERROR_METHOD_TYPE_MISMATCH};
+		bool definite = (typeCode == TypeCode::map);
+		uint64_t count = additional;
+		CborWalker item = enter();
+		for (uint64_t i = 0; definite ? (i < count) : !item.isExit(); ++i) {
+			if (item.error()) return item;
+			bool found = match(item);
+			++item;
+			if (item.error()) return item;
+			if (item.isExit()) return {item.data, dataEnd, ERROR_INVALID_VALUE};
+			if (found) return item;
+			++item;
+		}
+		return {data, dataEnd, ERROR_NOT_FOUND};
+	}
+
+	friend struct CborMapIndex;
+	friend struct CborStringRefs;
+	friend struct CborDocument;
+	friend struct CborSplice;
+	friend struct CborPath;
+	friend struct CborProjection;
+
 	const unsigned char *data, *dataEnd, *dataNext;
 	enum class TypeCode {
 		integerP, integerN, bytes, utf8, array, map, tag, simple, float32, float64,
@@ -533,6 +1123,8 @@ protected:
 		double float64;
 		unsigned char additionalBytes[8];
 	};
+	CborSkipIndex *skipIndex = nullptr;
+	CborStringRefs *stringRefs = nullptr;
 };
 
 inline bool operator==(const CborWalker &cbor, const char *cstr) {
@@ -555,119 +1147,492 @@ inline bool operator!=(const char *cstr, const CborWalker &cbor) {
 	return !(cbor == cstr);
 }
 
-// Automatically skips over tags, but still lets you query them
-struct TaggedCborWalker : public CborWalker {
-	TaggedCborWalker() {}
-	TaggedCborWalker(const CborWalker& basic) : CborWalker(basic), tagStart(data) {
-		consumeTags();
-	}
-	TaggedCborWalker(const unsigned char *dataStart, const unsigned char *dataEnd) : CborWalker(dataStart, dataEnd), tagStart(dataStart) {
-		consumeTags();
-	}
-	
-	TaggedCborWalker next(size_t i=1) const {
-		return CborWalker::next(i);
+// Table for stringrefs (http://cbor.schmorp.de/stringref): inside a namespace (tag 256), tag 25 + N refers to the Nth string written before it
+// Attach it with `CborWalker::withStringRefs()`, and `TaggedCborWalker` fills it in lazily when it meets a namespace, then resolves references transparently.
+// Like `CborSkipIndex`, it stores pointers, so only use it with one buffer (or call `.clear()` between buffers).
+// A resolved `TaggedCborWalker` points at the referenced string - use its own `.next()`, because its `CborWalker` base continues after the string, not the reference.
+struct CborStringRefs {
+	// Whether a string is long enough to be given an index, when there are already `index` strings in the namespace - so a reference is never longer than the string itself
+	static bool worthReferencing(uint64_t index, size_t length) {
+		return length >= (index < 24 ? 3 : index < 256 ? 4 : index < 65536 ? 5 : index < 4294967296ull ? 7 : 11);
 	}
-	TaggedCborWalker & operator++() {
-		CborWalker::operator++();
-		return *this;
-	}
-	TaggedCborWalker operator++(int _) {
-		return CborWalker::operator++(_);
-	}
-	TaggedCborWalker enter() const {
-		return CborWalker::enter();
-	}
-	TaggedCborWalker nextExit() const {
-		return CborWalker::nextExit();
+
+	// Records the strings of every namespace in an item (which can be the namespace itself), and returns the position after it
+	CborWalker scan(const CborWalker &item) {
+		size_t existing = namespaces.size();
+		CborWalker end = scanItem(item, noNamespace, 0);
+		// Keep them sorted by start position (they're added in order within one scan, but scans might not be in order)
+		if (existing && namespaces.size() > existing && namespaces[existing].start < namespaces[existing - 1].start) {
+			std::sort(namespaces.begin(), namespaces.end(), [](const Namespace &a, const Namespace &b){
+				return a.start < b.start;
+			});
+		}
+		return end;
 	}
-	template<class Fn>
-	TaggedCborWalker forEach(Fn &&fn) const {
-		return CborWalker::forEach([&](const CborWalker &item, size_t i){
-			fn(TaggedCborWalker{item}, i);
+	// Whether the namespace starting at this position (the tag 256 head) has been scanned
+	bool contains(const unsigned char *namespaceStart) const {
+		auto iter = std::lower_bound(namespaces.begin(), namespaces.end(), namespaceStart, [](const Namespace &n, const unsigned char *start){
+			return n.start < start;
 		});
+		return iter != namespaces.end() && iter->start == namespaceStart;
 	}
-	template<class Fn>
-	TaggedCborWalker forEachPair(Fn &&fn) const {
-		return CborWalker::forEachPair([&](const CborWalker &key, const CborWalker &value){
-			fn(TaggedCborWalker{key}, TaggedCborWalker{value});
+	// The head of string `index` in the innermost namespace around `position`, or `nullptr` if there isn't one
+	const unsigned char * find(const unsigned char *position, uint64_t index) const {
+		auto iter = std::upper_bound(namespaces.begin(), namespaces.end(), position, [](const unsigned char *pos, const Namespace &n){
+			return pos < n.start;
 		});
-	}
-	
-	size_t tagCount() const {
-		return nTags;
-	}
-	
-	uint64_t tag(size_t tagIndex) const {
-		CborWalker tagWalker(tagStart, dataEnd);
-		for (size_t i = 0; i < tagIndex; ++i) {
-			tagWalker = tagWalker.enter();
+		while (iter != namespaces.begin()) {
+			--iter;
+			if (position < iter->end) {
+				return (index < iter->strings.size()) ? iter->strings[(size_t)index] : nullptr;
+			}
 		}
-		return tagWalker;
-	}
-	
-	bool isTypedArray() const {
-		return isBytes() && typedArrayTag;
+		return nullptr;
 	}
-	
-	size_t typedArrayLength() const {
-		uint8_t widthLog2 = typedArrayTag&0x03;
-		uint8_t elementType = (typedArrayTag&0x18)>>3; // unsigned, signed, float
-		widthLog2 += (elementType == 2); // int sizes are 8-64 bits, float sizes are 16-128
-		size_t stride = 1<<widthLog2;
-		return length()/stride;
+
+	void clear() {
+		namespaces.clear();
 	}
-	
-	template<class Array>
-	size_t readTypedArray(Array &&array) const {
-		return readTypedArray(array, 0, typedArrayLength());
+	// Number of namespaces
+	size_t size() const {
+		return namespaces.size();
 	}
 
-	template<class Array>
+private:
+	struct Namespace {
+		const unsigned char *start, *end;
+		std::vector<const unsigned char *> strings;
+	};
+	std::vector<Namespace> namespaces;
+	static constexpr size_t noNamespace = ~size_t(0);
+
+	// Single pass over the item, adding definite-length strings to the current namespace
+	CborWalker scanItem(const CborWalker &item, size_t current, size_t depth) {
+		using TypeCode = CborWalker::TypeCode;
+		if (depth > CBOR_WALKER_MAX_DEPTH) return {item.data, item.dataEnd, CborWalker::ERROR_TOO_DEEP};
+		switch (item.typeCode) {
+		case TypeCode::bytes:
+		case TypeCode::utf8:
+			if (current != noNamespace) {
+				auto &strings = namespaces[current].strings;
+				if (worthReferencing(strings.size(), item.length())) strings.push_back(item.data);
+			}
+			return item.next();
+		case TypeCode::tag: {
+			CborWalker inner = item.enter();
+			if (item.additional == 256) {
+				size_t index = namespaces.size();
+				namespaces.push_back({item.data, item.dataEnd, {}});
+				CborWalker end = scanItem(inner, index, depth + 1);
+				namespaces[index].end = end.data;
+				return end;
+			} else if (item.additional == 25 && inner.typeCode == TypeCode::integerP) {
+				return inner.next(); // references aren't added to the table
+			}
+			return scanItem(inner, current, depth + 1);
+		}
+		case TypeCode::array:
+		case TypeCode::map: {
+			uint64_t count = item.additional;
+			bool isMap = (item.typeCode == TypeCode::map);
+			CborWalker child = item.enter();
+			for (uint64_t i = 0; i < count && !child.error(); ++i) {
+				child = scanItem(child, current, depth + 1);
+				if (isMap && !child.error()) child = scanItem(child, current, depth + 1);
+			}
+			return child;
+		}
+		case TypeCode::indefiniteArray:
+		case TypeCode::indefiniteMap: {
+			CborWalker child = item.enter();
+			while (!child.error() && !child.isExit()) {
+				child = scanItem(child, current, depth + 1);
+			}
+			return child.error() ? child : child.nextBasic();
+		}
+		default:
+			return item.next(); // including indefinite-length strings, whose chunks aren't added
+		}
+	}
+};
+
+inline CborWalker CborWalker::resolveStringRef() const {
+	if (typeCode != TypeCode::tag || additional != 25 || !stringRefs) return *this;
+	CborWalker index = nextBasic();
+	if (index.typeCode != TypeCode::integerP) return *this;
+	const unsigned char *string = stringRefs->find(data, index.additional);
+	return string ? walkerAt(string) : *this;
+}
+
+// Hash index of a single map's keys (UTF-8 or integer), so that repeated lookups are constant-time
+// It stores pointers into the buffer, so it's only valid as long as the map's data is
+struct CborMapIndex {
+	CborMapIndex() {}
+	CborMapIndex(const CborWalker &map) {
+		build(map);
+	}
+
+	// Returns the position after the map (or an error)
+	CborWalker build(const CborWalker &map) {
+		origin = map;
+		entries.clear();
+		count = smallCount = 0;
+		std::fill(smallKeys, smallKeys + 24, nullptr);
+		if (!map.isMap()) return {map.data, map.dataEnd, CborWalker::ERROR_METHOD_TYPE_MISMATCH};
+		expectedKeys = (map.typeCode == CborWalker::TypeCode::map) ? map.length() : 0;
+		return map.forEachPair([&](const CborWalker &refOrKey, const CborWalker &value){
+			CborWalker key = refOrKey.resolveStringRef();
+			uint64_t h;
+			if (key.typeCode == CborWalker::TypeCode::integerP && key.additional < 24) {
+				// Small integer keys (as used by COSE/CWT) go in a dense table, without hashing
+				if (!smallKeys[key.additional]) {
+					smallKeys[key.additional] = value.data;
+					++smallCount;
+				}
+				return;
+			} else if (key.typeCode == CborWalker::TypeCode::utf8) {
+				h = hashUtf8((const char *)key.dataNext, key.length());
+			} else if (key.isInt()) {
+				h = hashInt(key.typeCode == CborWalker::TypeCode::integerN, key.additional);
+			} else {
+				return; // not indexed
+			}
+			insert(h, key.data, value.data);
+		});
+	}
+
+	CborWalker find(const char *key, size_t keyLength) const {
+		return findHashed(hashUtf8(key, keyLength), [&](const CborWalker &k){
+			return k.matchesUtf8(key, keyLength);
+		});
+	}
+	CborWalker find(const char *key) const {
+		return find(key, std::strlen(key));
+	}
+	CborWalker find(const std::string &key) const {
+		return find(key.data(), key.size());
+	}
+#ifdef CBOR_WALKER_USE_STRING_VIEW
+	CborWalker find(const std::string_view &key) const {
+		return find(key.data(), key.size());
+	}
+#endif
+	template<typename Int>
+	typename std::enable_if<std::is_integral<Int>::value, CborWalker>::type find(Int key) const {
+		bool negative = (key < 0);
+		uint64_t magnitude = negative ? (uint64_t)(-1 - (int64_t)key) : (uint64_t)key;
+		if (!negative && magnitude < 24) {
+			if (!smallKeys[magnitude]) return {origin.data, origin.dataEnd, CborWalker::ERROR_NOT_FOUND};
+			return origin.walkerAt(smallKeys[magnitude]);
+		}
+		return findHashed(hashInt(negative, magnitude), [&](const CborWalker &k){
+			return k.matchesInt(negative, magnitude);
+		});
+	}
+	CborWalker operator[](const char *key) const {
+		return find(key);
+	}
+	CborWalker operator[](const std::string &key) const {
+		return find(key);
+	}
+
+	// Number of indexed keys
+	size_t size() const {
+		return count + smallCount;
+	}
+
+private:
+	struct Entry {
+		uint64_t hash;
+		const unsigned char *key, *value;
+	};
+	CborWalker origin;
+	std::vector<Entry> entries;
+	size_t count = 0, smallCount = 0, expectedKeys = 0;
+	const unsigned char *smallKeys[24] = {};
+
+	// FNV-1a
+	static uint64_t hashUtf8(const char *key, size_t length) {
+		uint64_t h = 0xCBF29CE484222325ull;
+		for (size_t i = 0; i < length; ++i) {
+			h = (h^(unsigned char)key[i])*0x100000001B3ull;
+		}
+		return h;
+	}
+	static uint64_t hashInt(bool negative, uint64_t magnitude) {
+		uint64_t h = (magnitude + negative)*0x9E3779B97F4A7C15ull;
+		return h^(h>>29)^(negative ? 0x5555555555555555ull : 0);
+	}
+
+	void reserve(size_t keys) {
+		size_t size = 16;
+		while (size < keys*2) size *= 2;
+		if (size > entries.size()) {
+			std::vector<Entry> old;
+			old.swap(entries);
+			entries.assign(size, Entry{0, nullptr, nullptr});
+			count = 0;
+			for (auto &e : old) {
+				if (e.key) insert(e.hash, e.key, e.value);
+			}
+		}
+	}
+	void insert(uint64_t hash, const unsigned char *key, const unsigned char *value) {
+		if (entries.empty()) reserve(expectedKeys); // not allocated until needed, so maps with only small keys don't allocate
+		if ((count + 1)*2 > entries.size()) reserve(count + 1);
+		size_t mask = entries.size() - 1;
+		size_t i = (size_t)hash&mask;
+		while (entries[i].key) {
+			// Duplicate keys: the first one wins, same as `CborWalker::find()`
+			if (entries[i].hash == hash && sameKey(entries[i].key, key)) return;
+			i = (i + 1)&mask;
+		}
+		entries[i] = {hash, key, value};
+		++count;
+	}
+	bool sameKey(const unsigned char *a, const unsigned char *b) const {
+		CborWalker keyA = origin.walkerAt(a), keyB = origin.walkerAt(b);
+		if (keyA.typeCode != keyB.typeCode || keyA.additional != keyB.additional) return false;
+		return keyA.typeCode != CborWalker::TypeCode::utf8 || !std::memcmp(keyA.dataNext, keyB.dataNext, keyA.length());
+	}
+
+	template<class Match>
+	CborWalker findHashed(uint64_t hash, Match &&match) const {
+		if (count) {
+			size_t mask = entries.size() - 1;
+			for (size_t i = (size_t)hash&mask; entries[i].key; i = (i + 1)&mask) {
+				if (entries[i].hash == hash && match(origin.walkerAt(entries[i].key))) {
+					return origin.walkerAt(entries[i].value);
+				}
+			}
+		}
+		return {origin.data, origin.dataEnd, CborWalker::ERROR_NOT_FOUND};
+	}
+};
+
+// RFC-8746 typed-array tag for an element type
+// bits: [1, 0] = log2(elementBytes),  [2] = isLittleEndian, [3, 4] = [unsigned, signed, float]
+template<typename T>
+uint8_t typedArrayTagFor(bool bigEndian=false) {
+	static_assert(std::is_arithmetic<T>::value && sizeof(T) <= 8, "typed arrays are ints or floats");
+	size_t size = sizeof(T);
+	uint8_t tag = 64;
+	if (std::is_floating_point<T>::value) {
+		tag |= 0x10;
+		size /= 2;
+	} else if (std::is_signed<T>::value) {
+		tag |= 0x08;
+	}
+	tag |= (size >= 8) ? 3 : (size >= 4) ? 2 : (size >= 2) ? 1 : 0;
+	if (!bigEndian && sizeof(T) > 1) tag |= 0x04;
+	return tag;
+}
+
+// A view of a typed array's payload, which byte-swaps on read if needed
+template<typename T>
+struct TypedArrayView {
+	TypedArrayView() {}
+	TypedArrayView(const unsigned char *bytes, size_t count, bool swapped) : bytes(bytes), count(count), swapped(swapped) {}
+
+	size_t size() const {
+		return count;
+	}
+	bool empty() const {
+		return !count;
+	}
+	// Native byte-order and suitably aligned, so `.data()` can be used directly
+	bool direct() const {
+		return !swapped && ((uintptr_t)bytes)%alignof(T) == 0;
+	}
+	const T * data() const {
+		return direct() ? (const T *)bytes : nullptr;
+	}
+
+	T operator[](size_t i) const {
+		using UInt = ByteOrder::UIntFor<T>;
+		UInt u;
+		std::memcpy(&u, bytes + i*sizeof(T), sizeof(T));
+		if (swapped) u = ByteOrder::swap(u);
+		T v;
+		std::memcpy(&v, &u, sizeof(T));
+		return v;
+	}
+	// Copies to native values, returning the number copied
+	size_t copyTo(T *output, size_t offset=0, size_t maxCount=~size_t(0)) const {
+		if (offset >= count) return 0;
+		size_t n = std::min(maxCount, count - offset);
+		if (swapped) {
+			ByteOrder::copySwapped<ByteOrder::UIntFor<T>>((unsigned char *)output, bytes + offset*sizeof(T), n);
+		} else {
+			std::memcpy(output, bytes + offset*sizeof(T), n*sizeof(T));
+		}
+		return n;
+	}
+
+	struct Iterator {
+		const TypedArrayView *view;
+		size_t index;
+
+		T operator*() const {
+			return (*view)[index];
+		}
+		Iterator & operator++() {
+			++index;
+			return *this;
+		}
+		bool operator==(const Iterator &other) const {
+			return index == other.index;
+		}
+		bool operator!=(const Iterator &other) const {
+			return index != other.index;
+		}
+	};
+	Iterator begin() const {
+		return {this, 0};
+	}
+	Iterator end() const {
+		return {this, count};
+	}
+private:
+	const unsigned char *bytes = nullptr;
+	size_t count = 0;
+	bool swapped = false;
+};
+
+// Automatically skips over tags, but still lets you query them
+struct TaggedCborWalker : public CborWalker {
+	TaggedCborWalker() {}
+	TaggedCborWalker(const CborWalker& basic) : CborWalker(basic), tagStart(data) {
+		consumeTags();
+	}
+	TaggedCborWalker(const unsigned char *dataStart, const unsigned char *dataEnd) : CborWalker(dataStart, dataEnd), tagStart(dataStart) {
+		consumeTags();
+	}
+	
+	TaggedCborWalker next(size_t i=1) const {
+		if (refEnd && i) return walkerAt(refEnd).next(i - 1); // resolved stringrefs continue after the reference, not the string
+		return CborWalker::next(i);
+	}
+	TaggedCborWalker & operator++() {
+		*this = next();
+		return *this;
+	}
+	TaggedCborWalker operator++(int) {
+		TaggedCborWalker result = *this;
+		*this = next();
+		return result;
+	}
+	TaggedCborWalker enter() const {
+		if (refEnd) return walkerAt(refEnd);
+		return CborWalker::enter();
+	}
+	TaggedCborWalker nextExit() const {
+		if (refEnd) return walkerAt(refEnd).nextExit();
+		return CborWalker::nextExit();
+	}
+	template<class Fn>
+	TaggedCborWalker forEach(Fn &&fn) const {
+		return CborWalker::forEach([&](const CborWalker &item, size_t i){
+			fn(TaggedCborWalker{item}, i);
+		});
+	}
+	template<class Fn>
+	TaggedCborWalker forEachPair(Fn &&fn) const {
+		return CborWalker::forEachPair([&](const CborWalker &key, const CborWalker &value){
+			fn(TaggedCborWalker{key}, TaggedCborWalker{value});
+		});
+	}
+	
+	template<class Key>
+	TaggedCborWalker find(Key &&key) const {
+		return CborWalker::find(key);
+	}
+	TaggedCborWalker operator[](const char *key) const {
+		return find(key);
+	}
+	TaggedCborWalker operator[](const std::string &key) const {
+		return find(key);
+	}
+	
+	size_t tagCount() const {
+		return nTags;
+	}
+	
+	uint64_t tag(size_t tagIndex) const {
+		CborWalker tagWalker(tagStart, dataEnd);
+		for (size_t i = 0; i < tagIndex; ++i) {
+			tagWalker = tagWalker.enter();
+		}
+		return tagWalker;
+	}
+	
+	bool isTypedArray() const {
+		return isBytes() && typedArrayTag;
+	}
+	
+	// Whether this is a typed array with elements of exactly type `T` (any endianness)
+	template<typename T>
+	bool isTypedArrayOf() const {
+		if (!isTypedArray()) return false;
+		return (typedArrayTag&0xFB) == typedArrayTagFor<T>(true); // (for single bytes, this treats "clamped" as plain uint8)
+	}
+
+	// View of the payload without copying, or an empty view if the element type doesn't match exactly
+	template<typename T>
+	TypedArrayView<T> typedArrayView() const {
+		if (!isTypedArrayOf<T>()) return {};
+		bool bigEndian = (sizeof(T) > 1) && !(typedArrayTag&0x04);
+#ifdef CBOR_WALKER_LITTLE_ENDIAN
+		bool swapped = bigEndian;
+#else
+		bool swapped = !bigEndian && sizeof(T) > 1;
+#endif
+		return {dataNext, length()/sizeof(T), swapped};
+	}
+
+	size_t typedArrayLength() const {
+		uint8_t widthLog2 = typedArrayTag&0x03;
+		uint8_t elementType = (typedArrayTag&0x18)>>3; // unsigned, signed, float
+		widthLog2 += (elementType == 2); // int sizes are 8-64 bits, float sizes are 16-128
+		size_t stride = 1<<widthLog2;
+		return length()/stride;
+	}
+	
+	template<class Array>
+	size_t readTypedArray(Array &&array) const {
+		return readTypedArray(array, 0, typedArrayLength());
+	}
+
+	template<class Array>
 	size_t readTypedArray(Array &&array, size_t offset, size_t maxCount) const {
-		size_t byteLength = length();
-		
 		bool bigEndian = !(typedArrayTag&0x04);
 		
 		switch (typedArrayTag&0xFB) { // without endian flag
 		// unsigned int
-		case 64: {
-			size_t count = std::min(maxCount, byteLength);
-			const uint8_t *bytes = dataNext + offset;
-			for (size_t i = 0; i < count; ++i) {
-				array[i] = bytes[i];
-			}
-			return count;
-		}
+		case 64:
+			return typedArrayReadInner<Array &, uint8_t, uint8_t>(array, offset, maxCount, bigEndian);
 		case 65:
-			return typedArrayReadInner<Array, uint16_t, uint16_t>(array, offset, maxCount, bigEndian);
+			return typedArrayReadInner<Array &, uint16_t, uint16_t>(array, offset, maxCount, bigEndian);
 		case 66:
-			return typedArrayReadInner<Array, uint32_t, uint32_t>(array, offset, maxCount, bigEndian);
+			return typedArrayReadInner<Array &, uint32_t, uint32_t>(array, offset, maxCount, bigEndian);
 		case 67:
-			return typedArrayReadInner<Array, uint64_t, uint64_t>(array, offset, maxCount, bigEndian);
+			return typedArrayReadInner<Array &, uint64_t, uint64_t>(array, offset, maxCount, bigEndian);
 		// signed int
-		case 72: {
-			size_t count = std::min(maxCount, byteLength);
-			const uint8_t *bytes = dataNext + offset;
-			for (size_t i = 0; i < count; ++i) {
-				array[i] = (int8_t)bytes[i]; // cast to signed here first, to make sure negatives behave correctly
-			}
-			return count;
-		}
+		case 72:
+			return typedArrayReadInner<Array &, uint8_t, int8_t>(array, offset, maxCount, bigEndian);
 		case 73:
-			return typedArrayReadInner<Array, uint16_t, int16_t>(array, offset, maxCount, bigEndian);
+			return typedArrayReadInner<Array &, uint16_t, int16_t>(array, offset, maxCount, bigEndian);
 		case 74:
-			return typedArrayReadInner<Array, uint32_t, int32_t>(array, offset, maxCount, bigEndian);
+			return typedArrayReadInner<Array &, uint32_t, int32_t>(array, offset, maxCount, bigEndian);
 		case 75:
-			return typedArrayReadInner<Array, uint64_t, int64_t>(array, offset, maxCount, bigEndian);
+			return typedArrayReadInner<Array &, uint64_t, int64_t>(array, offset, maxCount, bigEndian);
 		// floating-point
 		case 80:
-			// TODO: half-precision float support
-			return 0;
+			return typedArrayReadHalf(array, offset, maxCount, bigEndian);
 		case 81:
-			return typedArrayReadInner<Array, uint32_t, float, true>(array, offset, maxCount, bigEndian);
+			return typedArrayReadInner<Array &, uint32_t, float, true>(array, offset, maxCount, bigEndian);
 		case 82:
-			return typedArrayReadInner<Array, uint64_t, double, true>(array, offset, maxCount, bigEndian);
+			return typedArrayReadInner<Array &, uint64_t, double, true>(array, offset, maxCount, bigEndian);
 		case 83:
 			// TODO: quad-precision float support
 			return 0;
@@ -681,6 +1646,7 @@ private:
 	const unsigned char *tagStart;
 	
 	uint8_t typedArrayTag = 0;
+	const unsigned char *refEnd = nullptr;
 	
 	void consumeTags() {
 		while (isTagged() && data < dataEnd) {
@@ -688,306 +1654,2306 @@ private:
 			uint64_t tag = (*this);
 			if (tag >= 64 && tag < 87) { // RFC-8746 range
 				typedArrayTag = tag;
+			} else if (tag == 256 && stringRefs && !stringRefs->contains(data)) {
+				stringRefs->scan(*this);
+			} else if (tag == 25 && stringRefs) {
+				CborWalker string = resolveStringRef();
+				if (string.itemStart() != data) {
+					--nTags; // the reference is transparent
+					const unsigned char *refStart = data;
+					refEnd = CborWalker::next().itemStart();
+					CborWalker::operator=(string);
+					data = refStart; // the position (`.itemStart()`, edits, skip-index keys) is the reference, not the string
+					return;
+				}
 			}
 			// Move "into" the tag
-			CborWalker::operator=(enter());
+			CborWalker::operator=(CborWalker::enter());
 		}
 	}
 	
+	// If the output is a pointer/vector of exactly the right type, we can copy into it directly
+	template<typename T>
+	static T * contiguousArray(T *pointer) {
+		return pointer;
+	}
+	template<typename T>
+	static T * contiguousArray(std::vector<T> &vector) {
+		return vector.data();
+	}
+	template<typename T, class Other>
+	static T * contiguousArray(Other &&) {
+		return nullptr;
+	}
+
 	template<class Array, typename UIntType, typename ResultT, bool bitcast=false>
 	size_t typedArrayReadInner(Array &&array, size_t offset, size_t maxCount, bool bigEndian) const {
 		constexpr size_t B = sizeof(UIntType);
-		if (offset*B > length()) return 0;
+		if (offset > length()/B) return 0;
 		const uint8_t *bytes = dataNext + offset*B;
 		size_t count = std::min(maxCount, length()/B - offset);
-		if (bigEndian) {
-			for (size_t i = 0; i < count; ++i) {
-				UIntType v = 0;
-				for (size_t b = 0; b < B; ++b) {
-					UIntType bv = bytes[i*B + b];
-					v += bv<<((B - 1 - b)*8);
-				}
-				if (bitcast) {
-#ifdef CBOR_WALKER_USE_BIT_CAST
-					array[i] = std::bit_cast<ResultT>(v);
-#else
-					ResultT r;
-					std::memcpy(&r, &v, B);
-					array[i] = r;
-#endif
-				} else {
-					array[i] = (ResultT)v;
-				}
+		if (ResultT *output = contiguousArray<ResultT>(array)) {
+			if (bigEndian) {
+				ByteOrder::copyBig<UIntType>(output, bytes, count);
+			} else {
+				ByteOrder::copyLittle<UIntType>(output, bytes, count);
 			}
-		} else {
-			for (size_t i = 0; i < count; ++i) {
-				UIntType v = 0;
-				for (size_t b = 0; b < B; ++b) {
-					UIntType bv = bytes[i*B + b];
-					v += bv<<(b*8);
-				}
-				if (bitcast) {
+			return count;
+		}
+		for (size_t i = 0; i < count; ++i) {
+			UIntType v = bigEndian ? ByteOrder::loadBig<UIntType>(bytes + i*B) : ByteOrder::loadLittle<UIntType>(bytes + i*B);
+			if (bitcast) {
 #ifdef CBOR_WALKER_USE_BIT_CAST
-					array[i] = std::bit_cast<ResultT>(v);
+				array[i] = std::bit_cast<ResultT>(v);
 #else
-					ResultT r;
-					std::memcpy(&r, &v, B);
-					array[i] = r;
+				ResultT r;
+				std::memcpy(&r, &v, B);
+				array[i] = r;
 #endif
+			} else {
+				array[i] = (ResultT)v;
+			}
+		}
+		return count;
+	}
+	
+	// Half-precision floats are widened to `float` (so this works for any array of float/double)
+	template<class Array>
+	size_t typedArrayReadHalf(Array &&array, size_t offset, size_t maxCount, bool bigEndian) const {
+		if (offset > length()/2) return 0;
+		const uint8_t *bytes = dataNext + offset*2;
+		size_t count = std::min(maxCount, length()/2 - offset);
+		if (float *output = contiguousArray<float>(array)) {
+			constexpr size_t chunkLength = 1024;
+			uint16_t halves[chunkLength];
+			for (size_t start = 0; start < count; start += chunkLength) {
+				size_t chunkCount = std::min(chunkLength, count - start);
+				if (bigEndian) {
+					ByteOrder::copyBig<uint16_t>(halves, bytes + start*2, chunkCount);
 				} else {
-					array[i] = (ResultT)v;
+					ByteOrder::copyLittle<uint16_t>(halves, bytes + start*2, chunkCount);
 				}
+				Float16::toFloats(halves, output + start, chunkCount);
 			}
+			return count;
+		}
+		for (size_t i = 0; i < count; ++i) {
+			uint16_t v = bigEndian ? ByteOrder::loadBig<uint16_t>(bytes + i*2) : ByteOrder::loadLittle<uint16_t>(bytes + i*2);
+			array[i] = Float16::toFloat(v);
 		}
 		return count;
 	}
 };
 
-template<class SubClassCRTP>
-struct CborWriterBase {
-	void addUInt(uint64_t u) {
-		writeHead(0, u);
-	}
-	void addInt(int64_t u) {
-		if (u >= 0) {
-			writeHead(0, u);
+// Checks whether a string is valid UTF-8 (no overlong encodings, surrogates or codepoints above U+10FFFF)
+inline bool validUtf8(const unsigned char *bytes, size_t length) {
+	size_t i = 0;
+	while (i < length) {
+		// ASCII fast-path, 8 bytes at a time
+		while (length - i >= 8) {
+			uint64_t word;
+			std::memcpy(&word, bytes + i, 8);
+			if (word&0x8080808080808080ull) break;
+			i += 8;
+		}
+		if (i >= length) break;
+		unsigned char c = bytes[i];
+		if (c < 0x80) {
+			++i;
+			continue;
+		}
+		size_t extra;
+		uint32_t codepoint, minCodepoint;
+		if ((c&0xE0) == 0xC0) {
+			extra = 1;
+			codepoint = c&0x1F;
+			minCodepoint = 0x80;
+		} else if ((c&0xF0) == 0xE0) {
+			extra = 2;
+			codepoint = c&0x0F;
+			minCodepoint = 0x800;
+		} else if ((c&0xF8) == 0xF0) {
+			extra = 3;
+			codepoint = c&0x07;
+			minCodepoint = 0x10000;
 		} else {
-			writeHead(1, -1 - u);
+			return false;
 		}
+		if (length - i <= extra) return false;
+		for (size_t e = 1; e <= extra; ++e) {
+			unsigned char continuation = bytes[i + e];
+			if ((continuation&0xC0) != 0x80) return false;
+			codepoint = (codepoint<<6)|(continuation&0x3F);
+		}
+		if (codepoint < minCodepoint || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint < 0xE000)) return false;
+		i += extra + 1;
 	}
-	void addTag(uint64_t u) {
-		writeHead(6, u);
-	}
-	void addBool(bool b) {
-		writeHead(7, 20 + b);
-	}
-	void openArray() {
-		sub().writeByte(0x9F);
-	}
-	void openArray(size_t items) {
-		writeHead(4, items);
-	}
-	void openMap() {
-		sub().writeByte(0xBF);
-	}
-	void openMap(size_t pairs) {
-		writeHead(5, pairs);
-	}
-	void close() {
-		sub().writeByte(0xFF);
-	}
-	void addBytes(const void *ptr, size_t length) {
-		addBytes((const unsigned char *)ptr, length);
-	}
-	void addBytes(const unsigned char *ptr, size_t length) {
-		writeHead(2, length);
-		sub().writeBytes(ptr, length);
-	}
-	void openBytes() {
-		sub().writeByte(0x5F);
+	return true;
+}
+
+struct CborValidateLimits {
+	// Nesting depth of arrays/maps/tags/indefinite strings - the default matches what `CborWalker` can skip over
+	size_t maxDepth = CBOR_WALKER_MAX_DEPTH;
+	uint64_t maxItems = ~uint64_t(0);
+	// Allow any number of top-level items (RFC 8742 CBOR Sequence), instead of exactly one
+	bool sequence = false;
+	bool checkUtf8 = false;
+};
+
+struct CborValidateResult {
+	// One of the `CborWalker::ERROR_...` codes, or 0
+	uint64_t error = 0;
+	// Offset of the item which failed
+	size_t errorOffset = 0;
+	// Total number of items (including containers and tags)
+	uint64_t items = 0;
+
+	explicit operator bool() const {
+		return !error;
 	}
-	void addUtf8(const char *ptr, size_t length) {
-		writeHead(3, length);
-		sub().writeBytes((const unsigned char *)ptr, length);
+};
+
+// SAX-style hooks for `visit()`: these are no-ops, so inherit and define the ones you need (they're resolved at compile-time, not virtual)
+struct CborVisitor {
+	static constexpr uint64_t indefinite = ~uint64_t(0);
+
+	void onInt(int64_t) {}
+	void onUInt(uint64_t) {} // only for values above INT64_MAX
+	void onNegative(uint64_t) {} // the value is (-1 - argument), only for values below INT64_MIN
+	void onFloat(double) {}
+	void onBool(bool) {}
+	void onNull() {}
+	void onUndefined() {}
+	void onSimple(uint64_t) {}
+	// Indefinite strings are `onBeginBytes()`/`onBeginUtf8()`, the chunks, then `onEndBytes()`/`onEndUtf8()`
+	void onBytes(const unsigned char *, size_t) {}
+	void onUtf8(const char *, size_t) {}
+	void onBeginBytes() {}
+	void onEndBytes() {}
+	void onBeginUtf8() {}
+	void onEndUtf8() {}
+	// `length` is `indefinite` for indefinite-length containers.  Maps alternate key/value items.
+	void onBeginArray(uint64_t /*length*/) {}
+	void onEndArray() {}
+	void onBeginMap(uint64_t /*pairs*/) {}
+	void onEndMap() {}
+	// Applies to the next item
+	void onTag(uint64_t) {}
+};
+
+// Walks a whole buffer in a single iterative pass, checking it (as `validate()`) and calling the visitor's hooks along the way
+// If the result is an error, the hooks have only seen the (well-formed) data before it.
+template<class Visitor>
+CborValidateResult visit(const unsigned char *data, size_t length, Visitor &visitor, const CborValidateLimits &limits=CborValidateLimits()) {
+	CborValidateResult result;
+	
+	enum class Frame : unsigned char {
+		root, rootSequence, array, map, tag, indefiniteArray, indefiniteMap, indefiniteBytes, indefiniteUtf8
+	};
+	struct Level {
+		Frame frame;
+		uint64_t remaining; // item count for definite containers, or key/value parity for indefinite maps
+	};
+	std::vector<Level> stack;
+	stack.reserve(16);
+	stack.push_back({limits.sequence ? Frame::rootSequence : Frame::root, 1});
+
+	const unsigned char *pos = data, *end = data + length;
+	auto fail = [&](uint64_t errorCode, const unsigned char *at) {
+		result.error = errorCode;
+		result.errorOffset = at - data;
+		return result;
+	};
+	if (!length && !limits.sequence) return fail(CborWalker::ERROR_END_OF_DATA, pos);
+
+	while (pos < end) {
+		Level &top = stack.back();
+		// Runs of single-byte integers: check 8 at once
+		bool runnable = (top.frame == Frame::array || top.frame == Frame::map) ? top.remaining > 8 : (top.frame == Frame::indefiniteArray || top.frame == Frame::indefiniteMap || top.frame == Frame::rootSequence);
+		if (runnable && end - pos >= 8) {
+			uint64_t word;
+			std::memcpy(&word, pos, 8);
+			// major type 0 or 1, and additional info < 24
+			if (!(word&0xC0C0C0C0C0C0C0C0ull) && !((word>>1)&word&0x0808080808080808ull)) {
+				if (limits.maxItems - result.items < 8) return fail(CborWalker::ERROR_TOO_MANY_ITEMS, pos);
+				result.items += 8;
+				for (size_t i = 0; i < 8; ++i) {
+					visitor.onInt((pos[i] < 0x20) ? int64_t(pos[i]) : -1 - int64_t(pos[i]&0x1F));
+				}
+				if (top.frame == Frame::array || top.frame == Frame::map) top.remaining -= 8;
+				pos += 8;
+				continue;
+			}
+		}
+
+		const unsigned char *itemStart = pos;
+		unsigned char head = *pos++;
+		unsigned char major = head>>5, remainder = head&0x1F;
+		if (top.frame == Frame::indefiniteBytes || top.frame == Frame::indefiniteUtf8) {
+			unsigned char chunkMajor = (top.frame == Frame::indefiniteBytes) ? 2 : 3;
+			if (head != 0xFF && (major != chunkMajor || remainder == 31)) return fail(CborWalker::ERROR_INCONSISTENT_INDEFINITE, itemStart);
+		}
+		
+		if (remainder == 31) {
+			if (major == 7) { // break
+				if (top.frame < Frame::indefiniteArray) return fail(CborWalker::ERROR_INVALID_VALUE, itemStart);
+				if (top.frame == Frame::indefiniteMap && top.remaining) return fail(CborWalker::ERROR_INVALID_VALUE, itemStart);
+				Frame frame = top.frame;
+				stack.pop_back();
+				if (frame == Frame::indefiniteArray) {
+					visitor.onEndArray();
+				} else if (frame == Frame::indefiniteMap) {
+					visitor.onEndMap();
+				} else if (frame == Frame::indefiniteBytes) {
+					visitor.onEndBytes();
+				} else {
+					visitor.onEndUtf8();
+				}
+			} else {
+				if (major == 0 || major == 1 || major == 6) return fail(CborWalker::ERROR_INVALID_ADDITIONAL, itemStart);
+				if (result.items++ >= limits.maxItems) return fail(CborWalker::ERROR_TOO_MANY_ITEMS, itemStart);
+				if (stack.size() > limits.maxDepth) return fail(CborWalker::ERROR_TOO_DEEP, itemStart);
+				Frame frame = (major == 2) ? Frame::indefiniteBytes : (major == 3) ? Frame::indefiniteUtf8 : (major == 4) ? Frame::indefiniteArray : Frame::indefiniteMap;
+				stack.push_back({frame, 0});
+				if (major == 2) {
+					visitor.onBeginBytes();
+				} else if (major == 3) {
+					visitor.onBeginUtf8();
+				} else if (major == 4) {
+					visitor.onBeginArray(CborVisitor::indefinite);
+				} else {
+					visitor.onBeginMap(CborVisitor::indefinite);
+				}
+				continue;
+			}
+		} else {
+			if (remainder >= 28) return fail(CborWalker::ERROR_INVALID_ADDITIONAL, itemStart);
+			uint64_t argument = remainder;
+			if (remainder >= 24) {
+				size_t argBytes = size_t(1)<<(remainder - 24);
+				if ((size_t)(end - pos) < argBytes) return fail(CborWalker::ERROR_END_OF_DATA, itemStart);
+				argument = 0;
+				for (size_t i = 0; i < argBytes; ++i) argument = (argument<<8)|pos[i];
+				pos += argBytes;
+			}
+			if (result.items++ >= limits.maxItems) return fail(CborWalker::ERROR_TOO_MANY_ITEMS, itemStart);
+
+			switch (major) {
+			case 0:
+				if (argument > uint64_t(INT64_MAX)) {
+					visitor.onUInt(argument);
+				} else {
+					visitor.onInt(int64_t(argument));
+				}
+				break;
+			case 1:
+				if (argument > uint64_t(INT64_MAX)) {
+					visitor.onNegative(argument);
+				} else {
+					visitor.onInt(-1 - int64_t(argument));
+				}
+				break;
+			case 2:
+			case 3:
+				if (argument > (uint64_t)(end - pos)) return fail(CborWalker::ERROR_END_OF_DATA, itemStart);
+				if (major == 3 && limits.checkUtf8 && !validUtf8(pos, (size_t)argument)) return fail(CborWalker::ERROR_INVALID_VALUE, itemStart);
+				if (major == 2) {
+					visitor.onBytes(pos, (size_t)argument);
+				} else {
+					visitor.onUtf8((const char *)pos, (size_t)argument);
+				}
+				pos += argument;
+				break;
+			case 4:
+			case 5:
+				if (argument) {
+					if (major == 5 && argument > ~uint64_t(0)/2) return fail(CborWalker::ERROR_END_OF_DATA, itemStart);
+					uint64_t count = (major == 5) ? argument*2 : argument;
+					// Every item is at least one byte
+					if (count > (uint64_t)(end - pos)) return fail(CborWalker::ERROR_END_OF_DATA, itemStart);
+					if (stack.size() > limits.maxDepth) return fail(CborWalker::ERROR_TOO_DEEP, itemStart);
+					stack.push_back({major == 5 ? Frame::map : Frame::array, count});
+				}
+				if (major == 4) {
+					visitor.onBeginArray(argument);
+					if (argument) continue;
+					visitor.onEndArray();
+				} else {
+					visitor.onBeginMap(argument);
+					if (argument) continue;
+					visitor.onEndMap();
+				}
+				break;
+			case 6:
+				if (stack.size() > limits.maxDepth) return fail(CborWalker::ERROR_TOO_DEEP, itemStart);
+				stack.push_back({Frame::tag, 1});
+				visitor.onTag(argument);
+				continue;
+			case 7:
+				// Two-byte simple values below 32 aren't well-formed
+				if (remainder == 24 && argument < 32) return fail(CborWalker::ERROR_INVALID_VALUE, itemStart);
+				if (remainder == 25) {
+					visitor.onFloat(Float16::toFloat(uint16_t(argument)));
+				} else if (remainder == 26) {
+					uint32_t bits = uint32_t(argument);
+					float f;
+					std::memcpy(&f, &bits, 4);
+					visitor.onFloat(f);
+				} else if (remainder == 27) {
+					double d;
+					std::memcpy(&d, &argument, 8);
+					visitor.onFloat(d);
+				} else if (argument == 20 || argument == 21) {
+					visitor.onBool(argument == 21);
+				} else if (argument == 22) {
+					visitor.onNull();
+				} else if (argument == 23) {
+					visitor.onUndefined();
+				} else {
+					visitor.onSimple(argument);
+				}
+				break;
+			}
+		}
+
+		// An item has finished - update the enclosing containers
+		while (true) {
+			Level &level = stack.back();
+			if (level.frame == Frame::root) {
+				return (pos == end) ? result : fail(CborWalker::ERROR_TRAILING_DATA, pos);
+			} else if (level.frame == Frame::array || level.frame == Frame::map || level.frame == Frame::tag) {
+				if (--level.remaining) break;
+				Frame frame = level.frame;
+				stack.pop_back(); // the container is complete, so it's an item in its parent
+				if (frame == Frame::array) {
+					visitor.onEndArray();
+				} else if (frame == Frame::map) {
+					visitor.onEndMap();
+				}
+			} else {
+				if (level.frame == Frame::indefiniteMap) level.remaining ^= 1;
+				break;
+			}
+		}
 	}
-	void addUtf8(const char *str) {
-		addUtf8(str, std::strlen(str));
+	if (stack.size() > 1 || stack.back().frame == Frame::root) return fail(CborWalker::ERROR_END_OF_DATA, pos);
+	return result;
+}
+
+// Checks a whole buffer in a single iterative pass: well-formedness, nesting, lengths and indefinite-length chunks
+// Buffers which pass can be walked without any bounds-checking (see `CBOR_WALKER_UNCHECKED`).
+inline CborValidateResult validate(const unsigned char *data, size_t length, const CborValidateLimits &limits=CborValidateLimits()) {
+	CborVisitor noOp;
+	return visit(data, length, noOp, limits);
+}
+inline CborValidateResult validate(const std::vector<unsigned char> &vector, const CborValidateLimits &limits=CborValidateLimits()) {
+	return validate(vector.data(), vector.size(), limits);
+}
+
+// Checks that a buffer is exactly one item in RFC 8949 section 4.2.1 "core deterministic encoding" (as written with `CborWriterBase::deterministic`):
+// shortest heads and floats, no indefinite lengths, and map keys in strictly increasing order of their encoded bytes (so no duplicates).  It doesn't check UTF-8 - use `validate()` for that.
+inline bool isCanonical(const unsigned char *data, size_t length, size_t maxDepth=CBOR_WALKER_MAX_DEPTH) {
+	struct Level {
+		uint64_t remaining;
+		bool isMap;
+		const unsigned char *keyStart, *previousKey, *previousKeyEnd;
+	};
+	Level stack[CBOR_WALKER_MAX_DEPTH];
+	if (maxDepth > CBOR_WALKER_MAX_DEPTH) maxDepth = CBOR_WALKER_MAX_DEPTH;
+	size_t depth = 0;
+	const unsigned char *pos = data, *end = data + length;
+	while (true) {
+		if (depth && stack[depth - 1].isMap && !(stack[depth - 1].remaining&1)) stack[depth - 1].keyStart = pos;
+		if (pos >= end) return false;
+		unsigned char type = *pos>>5, info = *pos&0x1F;
+		++pos;
+		uint64_t argument = info;
+		if (info >= 24) {
+			if (info > 27) return false; // indefinite, or reserved
+			size_t size = size_t(1)<<(info - 24);
+			if ((size_t)(end - pos) < size) return false;
+			argument = 0;
+			for (size_t i = 0; i < size; ++i) argument = (argument<<8)|pos[i];
+			pos += size;
+			if (type == 7) {
+				uint64_t narrow;
+				if (info == 24 && argument < 32) return false;
+				if (info == 26 && Float16::narrowFloat<5, 10>(uint32_t(argument), narrow)) return false;
+				if (info == 27 && (Float16::narrowFloat<5, 10>(argument, narrow) || Float16::narrowFloat<8, 23>(argument, narrow))) return false;
+			} else if (argument < (info == 24 ? 24 : uint64_t(1)<<(4<<(info - 24)))) {
+				return false; // could have been shorter
+			}
+		}
+		if (type == 2 || type == 3) {
+			if ((uint64_t)(end - pos) < argument) return false;
+			pos += argument;
+		} else if (type == 4 || type == 5 || type == 6) {
+			if (type != 6 && argument > (uint64_t)(end - pos)) return false;
+			uint64_t items = (type == 5) ? argument*2 : (type == 6) ? 1 : argument;
+			if (items) {
+				if (depth >= maxDepth) return false;
+				stack[depth++] = {items, type == 5, nullptr, nullptr, nullptr};
+				continue;
+			}
+		}
+		// The item is complete
+		while (depth) {
+			Level &level = stack[depth - 1];
+			--level.remaining;
+			if (level.isMap && (level.remaining&1)) { // just finished a key
+				if (level.previousKey) {
+					size_t previousLength = level.previousKeyEnd - level.previousKey, keyLength = pos - level.keyStart;
+					int c = std::memcmp(level.previousKey, level.keyStart, std::min(previousLength, keyLength));
+					if (c > 0 || (!c && previousLength >= keyLength)) return false;
+				}
+				level.previousKey = level.keyStart;
+				level.previousKeyEnd = pos;
+			}
+			if (level.remaining) break;
+			--depth;
+		}
+		if (!depth) return pos == end;
 	}
-	void addUtf8(const std::string &str) {
-		addUtf8(str.c_str());
+}
+inline bool isCanonical(const std::vector<unsigned char> &vector) {
+	return isCanonical(vector.data(), vector.size());
+}
+template<class Visitor>
+CborValidateResult visit(const std::vector<unsigned char> &vector, Visitor &visitor, const CborValidateLimits &limits=CborValidateLimits()) {
+	return visit(vector.data(), vector.size(), visitor, limits);
+}
+
+// Resumable push-parser for CBOR arriving in chunks (e.g. a CBOR Sequence read from a socket)
+// Each top-level item is passed to a callback as soon as its last byte arrives.  Only an incomplete item is copied (up to `maxItemBytes`), so memory use is bounded.
+struct CborStreamParser {
+	CborStreamParser(size_t maxItemBytes=~size_t(0), size_t maxDepth=CBOR_WALKER_MAX_DEPTH) : maxItemBytes(maxItemBytes), maxDepth(maxDepth) {}
+
+	// Calls `itemFn(const CborWalker &item)` for each complete item - the walker points into the chunk (or the internal buffer), so only use it during the callback
+	// Returns false on an error, after which all input is ignored until `reset()`
+	template<class Fn>
+	bool push(const unsigned char *bytes, size_t length, Fn &&itemFn) {
+		if (errorCode) return false;
+		const unsigned char *pos = bytes, *end = bytes + length;
+		const unsigned char *itemStart = pos; // where the current item's bytes start in this chunk
+		while (pos < end) {
+			bool finished;
+			if (skipRemaining) { // string payloads are skipped in bulk
+				size_t skip = (size_t)std::min<uint64_t>(skipRemaining, end - pos);
+				pos += skip;
+				skipRemaining -= skip;
+				finished = !skipRemaining;
+			} else if (argumentBytes) {
+				argument = (argument<<8)|*pos++;
+				if (--argumentBytes) continue;
+				finished = readHead(buffer.size() + (pos - itemStart));
+			} else {
+				initial = *pos++;
+				unsigned char remainder = initial&0x1F;
+				if (remainder >= 24 && remainder < 28) {
+					argumentBytes = size_t(1)<<(remainder - 24);
+					argument = 0;
+					continue;
+				}
+				argument = remainder;
+				finished = readHead(buffer.size() + (pos - itemStart));
+			}
+			if (errorCode) return false;
+			if (finished && finishItem()) {
+				if (buffer.size() + (pos - itemStart) > maxItemBytes) return fail(CborWalker::ERROR_TOO_LARGE);
+				if (buffer.empty()) {
+					itemFn(CborWalker(itemStart, pos));
+				} else {
+					buffer.insert(buffer.end(), itemStart, pos);
+					itemFn(CborWalker(buffer.data(), buffer.data() + buffer.size()));
+					buffer.clear();
+				}
+				itemStart = pos;
+			}
+		}
+		if (itemStart < end) {
+			if (buffer.size() + (end - itemStart) > maxItemBytes) return fail(CborWalker::ERROR_TOO_LARGE);
+			buffer.insert(buffer.end(), itemStart, end);
+		}
+		return true;
 	}
-#ifdef CBOR_WALKER_USE_STRING_VIEW
-	void addUtf8(const std::string_view &str) {
-		addUtf8(str.data(), str.size());
+	template<class Fn>
+	bool push(const std::vector<unsigned char> &bytes, Fn &&itemFn) {
+		return push(bytes.data(), bytes.size(), itemFn);
 	}
-#endif
-	void openUtf8() {
-		sub().writeByte(0x7F);
+
+	// Lower bound on how many more bytes are needed before the next item can complete
+	size_t bytesNeeded() const {
+		uint64_t needed = argumentBytes + skipRemaining;
+		bool inProgress = needed > 0;
+		for (size_t i = 0; i < stack.size(); ++i) {
+			const Level &level = stack[i];
+			bool openChild = inProgress || i + 1 < stack.size();
+			if (level.frame == Frame::indefiniteMap) {
+				needed += 1 + (level.remaining ^ openChild); // possibly a value, then the break
+			} else if (level.frame >= Frame::indefiniteArray) {
+				needed += 1;
+			} else {
+				needed += level.remaining - openChild;
+			}
+		}
+		return needed ? (size_t)std::min<uint64_t>(needed, ~size_t(0)) : 1;
 	}
-	void addNull() {
-		sub().writeByte(0xF6);
+	// Whether we're part-way through an item (so the end of the stream would truncate it)
+	bool partial() const {
+		return !stack.empty() || argumentBytes || skipRemaining || !buffer.empty();
 	}
-	void addUndefined() {
-		sub().writeByte(0xF7);
+	// One of the `CborWalker::ERROR_...` codes, or 0
+	uint64_t error() const {
+		return errorCode;
 	}
-	void addSimple(unsigned char k) {
-		writeHead(7, k);
+	
+	void reset() {
+		stack.clear();
+		buffer.clear();
+		argumentBytes = 0;
+		skipRemaining = 0;
+		errorCode = 0;
 	}
+private:
+	size_t maxItemBytes, maxDepth;
+
+	enum class Frame : unsigned char {
+		array, map, tag, indefiniteArray, indefiniteMap, indefiniteBytes, indefiniteUtf8
+	};
+	struct Level {
+		Frame frame;
+		uint64_t remaining; // item count for definite containers, or key/value parity for indefinite maps
+	};
+	std::vector<Level> stack;
+	std::vector<unsigned char> buffer;
 	
-	void addFloat(float v) {
-		sub().writeByte(0xFA);
-#ifdef CBOR_WALKER_USE_BIT_CAST
-		uint32_t vi = std::bit_cast<uint32_t>(v);
-#else
-		uint32_t vi;
-		std::memcpy(&vi, &v, 4);
-#endif
-		for (size_t i = 0; i < 4; ++i) {
-			auto shift = (3 - i)*8;
-			sub().writeByte((vi>>shift)&0xFF);
+	unsigned char initial = 0;
+	uint64_t argument = 0;
+	size_t argumentBytes = 0;
+	uint64_t skipRemaining = 0;
+	uint64_t errorCode = 0;
+	
+	bool fail(uint64_t code) {
+		errorCode = code;
+		return false;
+	}
+
+	// Called once a head is complete, and returns whether the item is also complete
+	bool readHead(uint64_t itemBytes) {
+		unsigned char major = initial>>5, remainder = initial&0x1F;
+		Frame top = stack.empty() ? Frame::array : stack.back().frame;
+		if (top == Frame::indefiniteBytes || top == Frame::indefiniteUtf8) {
+			unsigned char chunkMajor = (top == Frame::indefiniteBytes) ? 2 : 3;
+			if (initial != 0xFF && (major != chunkMajor || remainder == 31)) return fail(CborWalker::ERROR_INCONSISTENT_INDEFINITE);
+		}
+		if (remainder == 31) {
+			if (major == 7) { // break
+				if (stack.empty() || top < Frame::indefiniteArray) return fail(CborWalker::ERROR_INVALID_VALUE);
+				if (top == Frame::indefiniteMap && stack.back().remaining) return fail(CborWalker::ERROR_INVALID_VALUE);
+				stack.pop_back();
+				return true;
+			}
+			if (major == 0 || major == 1 || major == 6) return fail(CborWalker::ERROR_INVALID_ADDITIONAL);
+			if (stack.size() >= maxDepth) return fail(CborWalker::ERROR_TOO_DEEP);
+			Frame frame = (major == 2) ? Frame::indefiniteBytes : (major == 3) ? Frame::indefiniteUtf8 : (major == 4) ? Frame::indefiniteArray : Frame::indefiniteMap;
+			stack.push_back({frame, 0});
+			return false;
+		}
+		if (remainder >= 28) return fail(CborWalker::ERROR_INVALID_ADDITIONAL);
+		switch (major) {
+		case 2:
+		case 3:
+			// Fail early, instead of buffering most of an item which is too big
+			if (itemBytes > maxItemBytes || argument > maxItemBytes - itemBytes) return fail(CborWalker::ERROR_TOO_LARGE);
+			skipRemaining = argument;
+			return !argument;
+		case 4:
+		case 5:
+			if (!argument) return true;
+			if (major == 5 && argument > ~uint64_t(0)/2) return fail(CborWalker::ERROR_TOO_LARGE);
+			if (stack.size() >= maxDepth) return fail(CborWalker::ERROR_TOO_DEEP);
+			stack.push_back({major == 5 ? Frame::map : Frame::array, major == 5 ? argument*2 : argument});
+			return false;
+		case 6:
+			if (stack.size() >= maxDepth) return fail(CborWalker::ERROR_TOO_DEEP);
+			stack.push_back({Frame::tag, 1});
+			return false;
+		case 7:
+			// Two-byte simple values below 32 aren't well-formed
+			if (remainder == 24 && argument < 32) return fail(CborWalker::ERROR_INVALID_VALUE);
+			return true;
+		default:
+			return true;
 		}
 	}
-	void addFloat(double v) {
-		sub().writeByte(0xFB);
-#ifdef CBOR_WALKER_USE_BIT_CAST
-		uint64_t vi = std::bit_cast<uint64_t>(v);
-#else
-		uint64_t vi;
-		std::memcpy(&vi, &v, 8);
-#endif
-		for (size_t i = 0; i < 8; ++i) {
-			auto shift = (7 - i)*8;
-			sub().writeByte((vi>>shift)&0xFF);
+
+	// An item has finished - update the enclosing containers, and return whether it was a top-level item
+	bool finishItem() {
+		while (!stack.empty()) {
+			Level &level = stack.back();
+			if (level.frame >= Frame::indefiniteArray) {
+				if (level.frame == Frame::indefiniteMap) level.remaining ^= 1;
+				return false;
+			}
+			if (--level.remaining) return false;
+			stack.pop_back(); // the container is complete, so it's an item in its parent
 		}
+		return true;
 	}
-	
-	// RFC-8746 tags for typed arrays
-	// bits: [1, 0] = log2(elementBytes),  [2] = isLittleEndian, [3, 4] = [unsigned, signed, float]
-	void addTypedArray(const uint8_t *arr, size_t length) {
-		addTag(64);
-		addBytes((const void *)arr, length);
+};
+
+// Record boundaries for a CBOR Sequence (RFC 8742) or a large top-level array, found with one skip pass which doesn't read any values
+// Records can then be processed in parallel with `.forEachParallel()`.
+struct CborRecords {
+	// Each top-level item is a record
+	bool findSequence(const unsigned char *data, size_t length) {
+		reset(data);
+		const unsigned char *pos = data, *end = data + length;
+		while (pos < end) {
+			bounds.push_back(pos);
+			pos = skip(pos, end);
+			if (!pos) return false;
+		}
+		bounds.push_back(end);
+		return true;
 	}
-	void addTypedArray(const int8_t *arr, size_t length) {
-		addTag(72);
-		addBytes((const void *)arr, length);
+	bool findSequence(const std::vector<unsigned char> &vector) {
+		return findSequence(vector.data(), vector.size());
 	}
-	void addTypedArray(const uint16_t *arr, size_t length, bool bigEndian=false) {
-		addTag(bigEndian ? 65 : 69);
-		writeTypedBlock<uint16_t>(arr, length, bigEndian);
+	// Each item in a (definite or indefinite) top-level array is a record - anything after the array is ignored
+	bool findArray(const unsigned char *data, size_t length) {
+		reset(data);
+		const unsigned char *pos = data, *end = data + length;
+		if (pos == end) return fail(CborWalker::ERROR_END_OF_DATA, pos);
+		unsigned char head = *pos;
+		if ((head>>5) != 4) return fail(CborWalker::ERROR_METHOD_TYPE_MISMATCH, pos);
+		if (head == 0x9F) {
+			++pos;
+			while (true) {
+				if (pos == end) return fail(CborWalker::ERROR_END_OF_DATA, pos);
+				if (*pos == 0xFF) break;
+				bounds.push_back(pos);
+				pos = skip(pos, end);
+				if (!pos) return false;
+			}
+		} else {
+			uint64_t count;
+			pos = readHead(pos, end, count);
+			if (!pos) return false;
+			if (count > uint64_t(end - pos)) return fail(CborWalker::ERROR_END_OF_DATA, data);
+			bounds.reserve((size_t)count + 1);
+			for (uint64_t i = 0; i < count; ++i) {
+				bounds.push_back(pos);
+				pos = skip(pos, end);
+				if (!pos) return false;
+			}
+		}
+		bounds.push_back(pos);
+		return true;
 	}
-	void addTypedArray(const uint32_t *arr, size_t length, bool bigEndian=false) {
-		addTag(bigEndian ? 66 : 70);
-		writeTypedBlock<uint32_t>(arr, length, bigEndian);
+	bool findArray(const std::vector<unsigned char> &vector) {
+		return findArray(vector.data(), vector.size());
 	}
-	void addTypedArray(const uint64_t *arr, size_t length, bool bigEndian=false) {
-		addTag(bigEndian ? 67 : 71);
-		writeTypedBlock<uint64_t>(arr, length, bigEndian);
+
+	uint64_t error() const {
+		return errorCode;
 	}
-	// For signed ints, we make a proxy struct which casts them on-the-fly
-	void addTypedArray(const int16_t *arr, size_t length, bool bigEndian=false) {
-		addTag(bigEndian ? 73 : 77);
-		struct {
-			const int16_t *arr;
-			uint16_t operator[](size_t i) const {
-				return (uint16_t)(arr[i]);
-			}
-		} unsignedArray{arr};
-		writeTypedBlock<uint16_t>(unsignedArray, length, bigEndian);
+	// Offset of the item which failed
+	size_t errorOffset() const {
+		return errorPos - dataStart;
 	}
-	void addTypedArray(const int32_t *arr, size_t length, bool bigEndian=false) {
-		addTag(bigEndian ? 74 : 78);
-		struct {
-			const int32_t *arr;
-			uint32_t operator[](size_t i) const {
-				return (uint32_t)(arr[i]);
+	size_t size() const {
+		return bounds.empty() ? 0 : bounds.size() - 1;
+	}
+	// A walker which ends with its record
+	CborWalker operator[](size_t index) const {
+		return {bounds[index], bounds[index + 1]};
+	}
+
+	// Skips a single item, returning its end (or `nullptr` and setting `.error()`)
+	// Definite-length containers just add to a count of pending items, so only indefinite-length ones need a stack.
+	const unsigned char * skip(const unsigned char *pos, const unsigned char *end) {
+		uint64_t pending = 1, stack[CBOR_WALKER_MAX_DEPTH];
+		size_t depth = 0;
+		while (pending || depth) {
+			const unsigned char *itemStart = pos;
+			if (pos >= end) return failAt(CborWalker::ERROR_END_OF_DATA, itemStart);
+			unsigned char head = *pos, major = head>>5;
+			if (head == 0xFF) {
+				if (!depth || pending) return failAt(CborWalker::ERROR_INVALID_VALUE, itemStart);
+				pending = stack[--depth];
+				++pos;
+				continue;
 			}
-		} unsignedArray{arr};
-		writeTypedBlock<uint32_t>(unsignedArray, length, bigEndian);
+			if (pending) --pending;
+			if ((head&0x1F) == 31) {
+				++pos;
+				if (major == 2 || major == 3) {
+					// Chunks have to be definite strings of the same type
+					while (pos < end && *pos != 0xFF) {
+						if ((*pos>>5) != major) return failAt(CborWalker::ERROR_INCONSISTENT_INDEFINITE, itemStart);
+						uint64_t length;
+						pos = readHead(pos, end, length);
+						if (!pos) return nullptr;
+						if (length > uint64_t(end - pos)) return failAt(CborWalker::ERROR_END_OF_DATA, itemStart);
+						pos += length;
+					}
+					if (pos == end) return failAt(CborWalker::ERROR_END_OF_DATA, itemStart);
+					++pos;
+				} else if (major == 4 || major == 5) {
+					if (depth >= CBOR_WALKER_MAX_DEPTH) return failAt(CborWalker::ERROR_TOO_DEEP, itemStart);
+					stack[depth++] = pending;
+					pending = 0;
+				} else {
+					return failAt(CborWalker::ERROR_INVALID_ADDITIONAL, itemStart);
+				}
+				continue;
+			}
+			uint64_t argument;
+			pos = readHead(pos, end, argument);
+			if (!pos) return nullptr;
+			if (major == 2 || major == 3) {
+				if (argument > uint64_t(end - pos)) return failAt(CborWalker::ERROR_END_OF_DATA, itemStart);
+				pos += argument;
+			} else if (major == 4 || major == 5 || major == 6) {
+				// Every item is at least one byte
+				uint64_t available = uint64_t(end - pos);
+				if (major != 6 && argument > available) return failAt(CborWalker::ERROR_END_OF_DATA, itemStart);
+				pending += (major == 6) ? 1 : (major == 5) ? argument*2 : argument;
+				if (pending > available) return failAt(CborWalker::ERROR_END_OF_DATA, itemStart);
+			}
+		}
+		return pos;
 	}
-	void addTypedArray(const int64_t *arr, size_t length, bool bigEndian=false) {
-		addTag(bigEndian ? 75 : 79);
-		struct {
-			const int64_t *arr;
-			uint64_t operator[](size_t i) const {
-				return (uint64_t)(arr[i]);
+
+#ifndef CBOR_WALKER_NO_THREADS
+	// Calls `fn(const CborWalker &record, size_t index)` for every record, using `threads` threads (including this one, default: one per core)
+	// Records are grouped into tasks of `recordsPerTask` (default: roughly 64 tasks per thread), visited in order within a task but in no particular order overall.  `fn` must be thread-safe and mustn't throw.
+	template<class Fn>
+	void forEachParallel(Fn &&fn, size_t threads=0, size_t recordsPerTask=0) const {
+		size_t count = size();
+		if (!count) return;
+		if (!threads) threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+		if (!recordsPerTask) recordsPerTask = std::max<size_t>(1, count/(threads*64));
+		recordsPerTask = std::max<size_t>(recordsPerTask, (size_t)(count/0xFFFFFFFFull) + 1); // task indices are 32-bit
+		size_t tasks = (count + recordsPerTask - 1)/recordsPerTask;
+		runTasks(tasks, threads, [&](size_t task){
+			size_t index = task*recordsPerTask, indexEnd = std::min(count, index + recordsPerTask);
+			for (; index < indexEnd; ++index) fn((*this)[index], index);
+		});
+	}
+
+	// Calls `taskFn(size_t task)` for tasks `0 <= task < tasks` (which must fit in 32 bits) on a small work-stealing pool
+	// Each thread starts with an equal share of the tasks, and idle threads steal half of the remaining tasks from another one.
+	template<class TaskFn>
+	static void runTasks(size_t tasks, size_t threads, TaskFn &&taskFn) {
+		if (!threads) threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+		threads = std::min(threads, tasks);
+		if (!threads) return;
+
+		// Each thread's range of tasks is packed into one atomic (begin<<32 | end), so taking from the front and stealing from the back are both single compare-exchanges
+		struct alignas(64) TaskRange {
+			std::atomic<uint64_t> range;
+		};
+		std::vector<TaskRange> ranges(threads);
+		for (size_t t = 0; t < threads; ++t) {
+			uint64_t begin = tasks*t/threads, end = tasks*(t + 1)/threads;
+			ranges[t].range.store((begin<<32)|end, std::memory_order_relaxed);
+		}
+		auto takeFront = [&](std::atomic<uint64_t> &range, uint64_t &task) {
+			uint64_t value = range.load(std::memory_order_acquire);
+			while ((value>>32) < (value&0xFFFFFFFFull)) {
+				if (range.compare_exchange_weak(value, value + (uint64_t(1)<<32), std::memory_order_acq_rel)) {
+					task = value>>32;
+					return true;
+				}
+			}
+			return false;
+		};
+		auto steal = [&](size_t thief) {
+			for (size_t offset = 1; offset < threads; ++offset) {
+				std::atomic<uint64_t> &victim = ranges[(thief + offset)%threads].range;
+				uint64_t value = victim.load(std::memory_order_acquire);
+				while (true) {
+					uint64_t begin = value>>32, end = value&0xFFFFFFFFull;
+					if (begin >= end) break;
+					uint64_t middle = begin + (end - begin)/2;
+					if (victim.compare_exchange_weak(value, (begin<<32)|middle, std::memory_order_acq_rel)) {
+						// Only the owner adds to an empty range, so a plain store is enough
+						ranges[thief].range.store((middle<<32)|end, std::memory_order_release);
+						return true;
+					}
+				}
+			}
+			return false;
+		};
+		auto worker = [&](size_t t) {
+			uint64_t task;
+			while (true) {
+				if (takeFront(ranges[t].range, task)) {
+					taskFn((size_t)task);
+				} else if (!steal(t)) {
+					return;
+				}
 			}
-		} unsignedArray{arr};
-		writeTypedBlock<uint64_t>(unsignedArray, length, bigEndian);
+		};
+
+		std::vector<std::thread> pool;
+		pool.reserve(threads - 1);
+		for (size_t t = 1; t < threads; ++t) pool.emplace_back(worker, t);
+		worker(0);
+		for (auto &thread : pool) thread.join();
 	}
-	// Look, I'm not any happier about this than you are
-	void addTypedArray(const float *arr, size_t length, bool bigEndian=false) {
-		addTag(bigEndian ? 81 : 85);
-		struct {
-			const float *arr;
-			uint32_t operator[](size_t i) const {
-#ifdef CBOR_WALKER_USE_BIT_CAST
-				return std::bit_cast<uint32_t>(arr[i]);
-#else
-				float v = arr[i];
-				uint32_t vi;
-				std::memcpy(&vi, &v, 4);
-				return vi;
 #endif
+
+private:
+	std::vector<const unsigned char *> bounds; // record starts, followed by the end of the last one
+	const unsigned char *dataStart = nullptr, *errorPos = nullptr;
+	uint64_t errorCode = 0;
+
+	void reset(const unsigned char *data) {
+		bounds.clear();
+		dataStart = errorPos = data;
+		errorCode = 0;
+	}
+	bool fail(uint64_t code, const unsigned char *at) {
+		failAt(code, at);
+		return false;
+	}
+	const unsigned char * failAt(uint64_t code, const unsigned char *at) {
+		errorCode = code;
+		errorPos = at;
+		bounds.clear();
+		return nullptr;
+	}
+	// Reads a (non-indefinite) head, returning the position after it
+	const unsigned char * readHead(const unsigned char *pos, const unsigned char *end, uint64_t &argument) {
+		const unsigned char *itemStart = pos;
+		unsigned char info = *pos++&0x1F;
+		argument = info;
+		if (info >= 24) {
+			if (info >= 28) return failAt(CborWalker::ERROR_INVALID_ADDITIONAL, itemStart);
+			size_t argBytes = size_t(1)<<(info - 24);
+			if (size_t(end - pos) < argBytes) return failAt(CborWalker::ERROR_END_OF_DATA, itemStart);
+			argument = 0;
+			for (size_t i = 0; i < argBytes; ++i) argument = (argument<<8)|pos[i];
+			pos += argBytes;
+		}
+		return pos;
+	}
+};
+
+#ifdef CBOR_WALKER_MAPPED_FILE
+// Read-only view of a whole file, memory-mapped where possible so processing can start before it's all been read
+// Without `mmap()` (or with `CBOR_WALKER_NO_MMAP`) the file is read into memory instead, and the access hints do nothing.
+struct CborMappedFile {
+	enum class Access {normal, sequential, random};
+
+	CborMappedFile() {}
+	explicit CborMappedFile(const char *path, Access access=Access::sequential) {
+		open(path, access);
+	}
+	explicit CborMappedFile(const std::string &path, Access access=Access::sequential) {
+		open(path.c_str(), access);
+	}
+	CborMappedFile(const CborMappedFile &other) = delete;
+	CborMappedFile & operator=(const CborMappedFile &other) = delete;
+	// Moving hands over the mapping (or buffer), leaving the other one closed
+	CborMappedFile(CborMappedFile &&other) {
+		*this = std::move(other);
+	}
+	CborMappedFile & operator=(CborMappedFile &&other) {
+		if (this == &other) return *this;
+		close();
+#ifndef CBOR_WALKER_MMAP
+		buffer = std::move(other.buffer); // keeps the same storage, so `mappedData` stays valid
+#endif
+		mappedData = other.mappedData;
+		mappedSize = other.mappedSize;
+		isOpen = other.isOpen;
+		errorNumber = other.errorNumber;
+		other.mappedData = nullptr;
+		other.mappedSize = 0;
+		other.isOpen = false;
+		other.errorNumber = 0;
+		return *this;
+	}
+	~CborMappedFile() {
+		close();
+	}
+
+	// Returns false on failure, with the `errno` value in `.error()`
+	bool open(const char *path, Access access=Access::sequential) {
+		close();
+#ifdef CBOR_WALKER_MMAP
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0) return fail();
+		struct stat info;
+		if (::fstat(fd, &info) != 0) {
+			fail();
+			::close(fd);
+			return false;
+		}
+		mappedSize = (size_t)info.st_size;
+		if (mappedSize) {
+			void *mapped = ::mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapped == MAP_FAILED) {
+				fail();
+				mappedSize = 0;
+				::close(fd);
+				return false;
 			}
-		} unsignedArray{arr};
-		writeTypedBlock<uint32_t>(unsignedArray, length, bigEndian);
+			mappedData = (const unsigned char *)mapped;
+		}
+		::close(fd); // the mapping keeps its own reference
+		advise(access);
+#else
+		(void)access;
+		std::ifstream file(path, std::ios::binary);
+		if (!file) {
+			errorNumber = ENOENT;
+			return false;
+		}
+		buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		mappedData = buffer.data();
+		mappedSize = buffer.size();
+#endif
+		isOpen = true;
+		return true;
 	}
-	void addTypedArray(const double *arr, size_t length, bool bigEndian=false) {
-		addTag(bigEndian ? 82 : 86);
-		struct {
-			const double *arr;
-			uint64_t operator[](size_t i) const {
-#ifdef CBOR_WALKER_USE_BIT_CAST
-				return std::bit_cast<uint64_t>(arr[i]);
+	bool open(const std::string &path, Access access=Access::sequential) {
+		return open(path.c_str(), access);
+	}
+	void close() {
+#ifdef CBOR_WALKER_MMAP
+		if (mappedData) ::munmap((void *)mappedData, mappedSize);
 #else
-				double v = arr[i];
-				uint64_t vi;
-				std::memcpy(&vi, &v, 8);
-				return vi;
+		buffer.clear();
+		buffer.shrink_to_fit();
 #endif
-			}
-		} unsignedArray{arr};
-		writeTypedBlock<uint64_t>(unsignedArray, length, bigEndian);
+		mappedData = nullptr;
+		mappedSize = 0;
+		isOpen = false;
+		errorNumber = 0;
 	}
-private:
-	SubClassCRTP & sub() {
-		return *(SubClassCRTP *)this;
+
+	explicit operator bool() const {
+		return isOpen;
+	}
+	int error() const {
+		return errorNumber;
+	}
+	const unsigned char * data() const {
+		return mappedData;
+	}
+	size_t size() const {
+		return mappedSize;
+	}
+	CborWalker walker() const {
+		return {mappedData, mappedData + mappedSize};
 	}
 
-	void writeHead(unsigned char type, uint64_t argument) {
-		type <<= 5;
-		if (argument >= 4294967296ul) {
-			sub().writeByte(type|27);
-			for (size_t i = 0; i < 8; ++i) {
-				sub().writeByte(argument>>(56 - i*8));
-			}
-		} else if (argument >= 65536) {
-			sub().writeByte(type|26);
-			for (size_t i = 0; i < 4; ++i) {
-				sub().writeByte(argument>>(24 - i*8));
-			}
-		} else if (argument >= 256) {
-			sub().writeByte(type|25);
-			sub().writeByte(argument>>8);
-			sub().writeByte(argument);
-		} else if (argument >= 24) {
-			sub().writeByte(type|24);
-			sub().writeByte(argument);
-		} else {
-			sub().writeByte(type|argument);
-		}
+	// Hints for the whole file, or part of it
+	void advise(Access access) {
+		advise(mappedData, mappedSize, access);
 	}
-	
-	template<typename UIntType, class Array>
-	void writeTypedBlock(Array &&array, size_t length, bool bigEndian) {
-		constexpr size_t B = sizeof(UIntType);
-		writeHead(2, length*B);
-		if (bigEndian) {
-			for (size_t i = 0; i < length; ++i) {
-				UIntType v = array[i];
-				for (size_t b = 0; b < B; ++b) sub().writeByte((v>>((B-1-b)*8))&0xFF);
-			}
-		} else {
-			for (size_t i = 0; i < length; ++i) {
-				UIntType v = array[i];
-				for (size_t b = 0; b < B; ++b) sub().writeByte((v>>(b*8))&0xFF);
+	void advise(const unsigned char *start, size_t length, Access access) {
+#ifdef CBOR_WALKER_MMAP
+		int advice = (access == Access::sequential) ? MADV_SEQUENTIAL : (access == Access::random) ? MADV_RANDOM : MADV_NORMAL;
+		pageRange(start, length, [&](void *page, size_t pageLength){
+			::madvise(page, pageLength, advice);
+		});
+#else
+		(void)start;
+		(void)length;
+		(void)access;
+#endif
+	}
+	// Asks for a range to be read in the background
+	void prefetch(const unsigned char *start, size_t length) {
+#ifdef CBOR_WALKER_MMAP
+		pageRange(start, length, [&](void *page, size_t pageLength){
+			::madvise(page, pageLength, MADV_WILLNEED);
+		});
+#else
+		(void)start;
+		(void)length;
+#endif
+	}
+
+	// Calls `fn(const CborWalker &item)` for each top-level item (a CBOR Sequence), prefetching `prefetchBytes` ahead as it goes
+	// Returns false if there was an invalid or incomplete item (which isn't passed to `fn`).
+	template<class Fn>
+	bool forEachItem(Fn &&fn, size_t prefetchBytes=size_t(1)<<22) {
+		const unsigned char *end = mappedData + mappedSize, *prefetched = mappedData;
+		CborWalker item = walker();
+		while (!item.error()) {
+			// Keep at least half the window ahead of us
+			if (prefetchBytes && (size_t)(prefetched - item.itemStart()) < prefetchBytes/2 && prefetched < end) {
+				size_t length = std::min(prefetchBytes, (size_t)(end - prefetched));
+				prefetch(prefetched, length);
+				prefetched += length;
 			}
+			CborWalker next = item.next();
+			if (next.error() && (!next.atEnd() || next.itemStart() != end)) return false; // truncated data is also `.atEnd()`, but not at the end
+			fn(item);
+			item = next;
 		}
+		return item.atEnd() && item.itemStart() == end;
 	}
-};
 
-struct CborWriter : public CborWriterBase<CborWriter> {
-	CborWriter(std::vector<unsigned char> &bytes) : bytes(bytes) {}
-	
 private:
-	friend struct CborWriterBase<CborWriter>;
-
-	std::vector<unsigned char> &bytes;
-	void writeByte(unsigned char b) {
-		bytes.push_back(b);
+	const unsigned char *mappedData = nullptr;
+	size_t mappedSize = 0;
+	bool isOpen = false;
+	int errorNumber = 0;
+#ifdef CBOR_WALKER_MMAP
+	bool fail() {
+		errorNumber = errno;
+		return false;
 	}
-	void writeBytes(const unsigned char *ptr, size_t length) {
-		bytes.insert(bytes.end(), ptr, ptr + length);
+	// `madvise()` needs page-aligned ranges
+	template<class Fn>
+	void pageRange(const unsigned char *start, size_t length, Fn &&fn) {
+		if (!mappedData || start < mappedData || start >= mappedData + mappedSize) return;
+		length = std::min(length, (size_t)(mappedData + mappedSize - start));
+		static const size_t pageSize = (size_t)::sysconf(_SC_PAGESIZE);
+		size_t offset = (size_t)(start - mappedData), alignedOffset = offset - offset%pageSize;
+		fn((void *)(mappedData + alignedOffset), length + (offset - alignedOffset));
+	}
+#else
+	std::vector<unsigned char> buffer;
+#endif
+};
+#endif
+
+// Sidecar index for a CBOR Sequence: the offset of every `stride`-th record, so any record can be reached by skipping fewer than `stride` items
+// It's built in one pass, and stored as CBOR (a map with integer keys, with the offsets delta-encoded) so it can be saved next to the data.
+struct CborSequenceIndex {
+	// Returns false (with `.error()`) if the data isn't a valid sequence
+	bool build(const unsigned char *data, size_t length, size_t stride=1) {
+		clear();
+		this->stride = std::max<size_t>(stride, 1);
+		dataLength = length;
+		CborRecords scanner;
+		const unsigned char *pos = data, *end = data + length;
+		while (pos < end) {
+			if (recordCount%this->stride == 0) offsets.push_back(pos - data);
+			pos = scanner.skip(pos, end);
+			if (!pos) {
+				errorCode = scanner.error();
+				offsets.clear();
+				recordCount = 0;
+				return false;
+			}
+			++recordCount;
+		}
+		return true;
+	}
+	bool build(const std::vector<unsigned char> &vector, size_t stride=1) {
+		return build(vector.data(), vector.size(), stride);
+	}
+	void clear() {
+		offsets.clear();
+		recordCount = dataLength = 0;
+		stride = 1;
+		errorCode = 0;
+	}
+	uint64_t error() const {
+		return errorCode;
+	}
+
+	size_t size() const {
+		return (size_t)recordCount;
+	}
+	// Length of the indexed data, to detect a stale index
+	uint64_t indexedLength() const {
+		return dataLength;
+	}
+	size_t recordsPerCheckpoint() const {
+		return stride;
+	}
+	size_t checkpoints() const {
+		return offsets.size();
+	}
+	uint64_t checkpointOffset(size_t checkpoint) const {
+		return offsets[checkpoint];
+	}
+
+	// A walker at the record, or `.atEnd()` if it's out of range (or the index doesn't match the data)
+	CborWalker record(const unsigned char *data, size_t length, size_t index) const {
+		CborWalker endWalker(data + length, data + length);
+		if (index >= recordCount || length != dataLength) return endWalker;
+		return CborWalker(data + offsets[index/stride], data + length).next(index%stride);
+	}
+	CborWalker record(const std::vector<unsigned char> &vector, size_t index) const {
+		return record(vector.data(), vector.size(), index);
+	}
+
+	// For a sequence sorted by some key: the first record where `before(const CborWalker &record)` is false
+	// This is a binary search over the checkpoints, and then a scan of fewer than `stride` records.
+	template<class Before>
+	size_t lowerBound(const unsigned char *data, size_t length, Before &&before) const {
+		if (length != dataLength || !recordCount) return 0;
+		size_t low = 0, high = offsets.size(); // checkpoints before `low` are all before
+		while (low < high) {
+			size_t mid = low + (high - low)/2;
+			if (before(CborWalker(data + offsets[mid], data + length))) {
+				low = mid + 1;
+			} else {
+				high = mid;
+			}
+		}
+		if (!low) return 0;
+		size_t index = (low - 1)*stride + 1;
+		CborWalker item = CborWalker(data + offsets[low - 1], data + length).next();
+		for (; index < recordCount && index < low*stride; ++index) {
+			if (!before(item)) break;
+			++item;
+		}
+		return index;
+	}
+
+#ifndef CBOR_WALKER_NO_THREADS
+	// Calls `fn(const CborWalker &record, size_t index)` for every record, with each checkpoint's block of records as one task (see `CborRecords::runTasks()`)
+	template<class Fn>
+	bool forEachParallel(const unsigned char *data, size_t length, Fn &&fn, size_t threads=0) const {
+		if (length != dataLength) return false;
+		CborRecords::runTasks(offsets.size(), threads, [&](size_t checkpoint){
+			size_t index = checkpoint*stride, indexEnd = std::min<size_t>((size_t)recordCount, index + stride);
+			CborWalker item(data + offsets[checkpoint], data + length);
+			for (; index < indexEnd; ++index) fn(item++, index);
+		});
+		return true;
+	}
+#endif
+
+	template<class Writer>
+	void write(Writer &writer) const {
+		writer.openMap(4);
+		writer.addUInt(0);
+		writer.addUInt(recordCount);
+		writer.addUInt(1);
+		writer.addUInt(stride);
+		writer.addUInt(2);
+		writer.addUInt(dataLength);
+		writer.addUInt(3);
+		writer.openArray(offsets.size());
+		uint64_t previous = 0;
+		for (auto offset : offsets) {
+			writer.addUInt(offset - previous);
+			previous = offset;
+		}
+	}
+	// Returns false if it's not a valid index
+	bool read(const CborWalker &cbor) {
+		clear();
+		CborWalker count = cbor.find(0), strideItem = cbor.find(1), lengthItem = cbor.find(2), deltas = cbor.find(3);
+		if (!count.isInt() || !strideItem.isInt() || !lengthItem.isInt() || !deltas.isArray() || (uint64_t)strideItem == 0) return fail();
+		recordCount = count;
+		stride = (size_t)(uint64_t)strideItem;
+		dataLength = lengthItem;
+		// It's untrusted input: every record is at least one byte, and every checkpoint is a record start inside the data
+		if (recordCount > dataLength) return fail();
+		uint64_t offset = 0;
+		bool validDeltas = true;
+		CborWalker end = deltas.forEach([&](const CborWalker &delta, size_t){
+			validDeltas = validDeltas && delta.isInt() && !delta.isNegativeInt();
+			offset += (uint64_t)delta;
+			offsets.push_back(offset);
+		});
+		if (!validDeltas || (end.error() && !end.atEnd())) return fail();
+		if (offsets.size() != recordCount/stride + (recordCount%stride ? 1 : 0)) return fail();
+		for (size_t i = 0; i < offsets.size(); ++i) {
+			if (offsets[i] >= dataLength || (i ? offsets[i] <= offsets[i - 1] : offsets[i] != 0)) return fail();
+		}
+		return true;
+	}
+
+private:
+	std::vector<uint64_t> offsets;
+	uint64_t recordCount = 0, dataLength = 0;
+	size_t stride = 1;
+	uint64_t errorCode = 0;
+
+	bool fail() {
+		clear();
+		errorCode = CborWalker::ERROR_INVALID_VALUE;
+		return false;
+	}
+};
+
+// Path expressions, compiled once and then run over any number of documents.  Two syntaxes are accepted:
+//	JSONPath-like: `$.events[*].payload.id`, `$['a key'][0]`, `$[-1]` (from the end of a definite array), `$..id` (at any depth), `.*` (all array items or map values)
+//	JSON Pointer (RFC 6901): `/events/0/payload/id`, or `""` for the whole document
+// On a map, `[N]` matches the integer key N (and a JSON Pointer index also matches the text key).  Tags are passed through when navigating.
+// Only the matching path is entered: non-matching keys, values and items are skipped without being decoded.
+struct CborPath {
+	CborPath() {}
+	explicit CborPath(const char *expression) {
+		compile(expression);
+	}
+	explicit CborPath(const std::string &expression) {
+		compile(expression.c_str());
+	}
+
+	// Returns false for an invalid expression (with the position of the problem in `.errorOffset()`)
+	bool compile(const char *expression) {
+		steps.clear();
+		errorPos = 0;
+		valid = (expression[0] == '/' || !expression[0]) ? compilePointer(expression) : compileJsonPath(expression);
+		if (!valid) steps.clear();
+		return valid;
+	}
+	explicit operator bool() const {
+		return valid;
+	}
+	size_t errorOffset() const {
+		return errorPos;
+	}
+
+	// Calls `fn(const CborWalker &match)` for each match (in document order), returning the number of matches
+	template<class Fn>
+	size_t forEach(const CborWalker &root, Fn &&fn) const {
+		if (!valid) return 0;
+		size_t count = 0;
+		matchFrom(root, 0, 0, [&](const CborWalker &match){
+			++count;
+			fn(match);
+		});
+		return count;
+	}
+	std::vector<CborWalker> all(const CborWalker &root) const {
+		std::vector<CborWalker> result;
+		forEach(root, [&](const CborWalker &match){
+			result.push_back(match);
+		});
+		return result;
+	}
+	// The first match, or an error (`ERROR_NOT_FOUND`) - for paths with no wildcards, this only enters the matching path
+	CborWalker first(const CborWalker &root) const {
+		CborWalker result = {root.data, root.dataEnd, CborWalker::ERROR_NOT_FOUND};
+		if (!valid) return result;
+		bool found = false;
+		matchFrom(root, 0, 0, [&](const CborWalker &match){
+			if (!found) result = match;
+			found = true;
+		}, &found);
+		return result;
+	}
+
+private:
+	struct Step {
+		enum Kind : unsigned char {name, position, pointer, wildcard};
+		Kind kind;
+		bool descendant; // `..`: matches at this level or any depth below
+		std::string key; // for `name` and `pointer`
+		int64_t index; // for `position` and `pointer`
+		bool hasIndex; // a JSON Pointer segment which is a valid array index
+	};
+	friend struct CborProjection;
+
+	std::vector<Step> steps;
+	bool valid = false;
+	size_t errorPos = 0;
+
+	bool failAt(const char *expression, const char *pos) {
+		errorPos = pos - expression;
+		return false;
+	}
+
+	bool compilePointer(const char *expression) {
+		const char *pos = expression;
+		while (*pos == '/') {
+			++pos;
+			Step step{Step::pointer, false, "", 0, true};
+			while (*pos && *pos != '/') {
+				if (*pos == '~') {
+					if (pos[1] == '0') {
+						step.key += '~';
+					} else if (pos[1] == '1') {
+						step.key += '/';
+					} else {
+						return failAt(expression, pos);
+					}
+					pos += 2;
+				} else {
+					step.key += *pos++;
+				}
+			}
+			// Array indices are "0", or digits without a leading zero
+			step.hasIndex = !step.key.empty() && step.key.size() < 19 && (step.key == "0" || step.key[0] != '0');
+			for (char c : step.key) step.hasIndex = step.hasIndex && c >= '0' && c <= '9';
+			if (step.hasIndex) step.index = std::strtoll(step.key.c_str(), nullptr, 10);
+			steps.push_back(step);
+		}
+		if (*pos) return failAt(expression, pos);
+		return true;
+	}
+
+	bool compileJsonPath(const char *expression) {
+		const char *pos = expression;
+		if (*pos != '$') return failAt(expression, pos);
+		++pos;
+		while (*pos) {
+			Step step{Step::name, false, "", 0, false};
+			if (*pos == '.') {
+				++pos;
+				if (*pos == '.') {
+					step.descendant = true;
+					++pos;
+				}
+				if (*pos != '[') {
+					if (*pos == '*') {
+						step.kind = Step::wildcard;
+						++pos;
+					} else {
+						const char *start = pos;
+						while (*pos && *pos != '.' && *pos != '[') step.key += *pos++;
+						if (pos == start) return failAt(expression, pos);
+					}
+					steps.push_back(step);
+					continue;
+				}
+				if (!step.descendant) return failAt(expression, pos);
+			} else if (*pos != '[') {
+				return failAt(expression, pos);
+			}
+			// Bracketed: `[*]`, `['key']`, `["key"]` or `[N]`
+			++pos;
+			if (*pos == '*') {
+				step.kind = Step::wildcard;
+				++pos;
+			} else if (*pos == '\'' || *pos == '"') {
+				char quote = *pos++;
+				while (*pos != quote) {
+					if (!*pos) return failAt(expression, pos);
+					if (*pos == '\\' && pos[1]) ++pos;
+					step.key += *pos++;
+				}
+				++pos;
+			} else {
+				const char *start = pos;
+				if (*pos == '-') ++pos;
+				if (*pos < '0' || *pos > '9') return failAt(expression, pos);
+				while (*pos >= '0' && *pos <= '9') ++pos;
+				if (pos - start > 19) return failAt(expression, start);
+				step.kind = Step::position;
+				step.index = std::strtoll(start, nullptr, 10);
+			}
+			if (*pos != ']') return failAt(expression, pos);
+			++pos;
+			steps.push_back(step);
+		}
+		return true;
+	}
+
+	// `stop` (if given) ends the search early once it's set
+	template<class Fn>
+	void matchFrom(CborWalker item, size_t stepIndex, size_t depth, Fn &&fn, const bool *stop=nullptr) const {
+		if (stop && *stop) return;
+		if (stepIndex == steps.size()) {
+			fn(item);
+			return;
+		}
+		if (depth > CBOR_WALKER_MAX_DEPTH) return;
+		while (item.isTagged()) item = item.enter();
+		if (item.error()) return;
+		const Step &step = steps[stepIndex];
+		if (step.descendant) {
+			// This level, then every child (depth-first)
+			matchStep(item, step, stepIndex, depth, fn, stop);
+			forEachChild(item, [&](const CborWalker &child){
+				matchFrom(child, stepIndex, depth + 1, fn, stop);
+			}, stop);
+		} else {
+			matchStep(item, step, stepIndex, depth, fn, stop);
+		}
+	}
+
+	template<class Fn>
+	void matchStep(const CborWalker &item, const Step &step, size_t stepIndex, size_t depth, Fn &&fn, const bool *stop) const {
+		switch (step.kind) {
+		case Step::name: {
+			CborWalker value = item.find(step.key);
+			if (!value.error()) matchFrom(value, stepIndex + 1, depth + 1, fn, stop);
+			break;
+		}
+		case Step::position:
+		case Step::pointer: {
+			CborWalker value = {item.data, item.dataEnd, CborWalker::ERROR_NOT_FOUND};
+			if (item.isArray()) {
+				if (step.kind == Step::pointer && !step.hasIndex) break;
+				value = arrayItem(item, step.index);
+			} else if (item.isMap()) {
+				if (step.kind == Step::pointer) {
+					value = item.find(step.key);
+					if (value.error() && step.hasIndex) value = item.find(step.index);
+				} else {
+					value = item.find(step.index);
+				}
+			}
+			if (!value.error()) matchFrom(value, stepIndex + 1, depth + 1, fn, stop);
+			break;
+		}
+		case Step::wildcard:
+			forEachChild(item, [&](const CborWalker &child){
+				matchFrom(child, stepIndex + 1, depth + 1, fn, stop);
+			}, stop);
+			break;
+		}
+	}
+
+	static CborWalker arrayItem(const CborWalker &array, int64_t index) {
+		if (index < 0) {
+			if (!array.hasLength()) return {array.data, array.dataEnd, CborWalker::ERROR_NOT_FOUND};
+			index += (int64_t)array.length();
+			if (index < 0) return {array.data, array.dataEnd, CborWalker::ERROR_NOT_FOUND};
+		}
+		if (array.hasLength()) {
+			if ((uint64_t)index >= array.length()) return {array.data, array.dataEnd, CborWalker::ERROR_NOT_FOUND};
+			return array.enter().next((size_t)index);
+		}
+		CborWalker item = array.enter();
+		for (int64_t i = 0; i < index && !item.error() && !item.isExit(); ++i) ++item;
+		if (item.isExit()) return {array.data, array.dataEnd, CborWalker::ERROR_NOT_FOUND};
+		return item;
+	}
+
+	// Array items or map values
+	template<class Fn>
+	static void forEachChild(const CborWalker &item, Fn &&fn, const bool *stop) {
+		if (!item.isArray() && !item.isMap()) return;
+		bool definite = item.hasLength(), isMap = item.isMap();
+		uint64_t count = definite ? item.additional : 0;
+		CborWalker child = item.enter();
+		for (uint64_t i = 0; definite ? i < count : !child.isExit(); ++i) {
+			if (child.error() || (stop && *stop)) return;
+			if (isMap) {
+				++child;
+				if (child.error() || child.isExit()) return;
+			}
+			fn(child);
+			++child;
+		}
+	}
+};
+
+// Extracts a fixed set of paths in a single pass: each container along the way is walked once, and the walk stops as soon as every path has been found
+// Paths use the `CborPath` syntax, but without wildcards or `..` so each one fills a single slot.  They're merged into a trie of keys/indices, so paths with a common prefix share the walk.
+struct CborProjection {
+	CborProjection() {}
+	CborProjection(std::initializer_list<const char *> expressions) {
+		for (auto expression : expressions) add(expression);
+	}
+
+	// Adds a path as the next slot - returns false (and invalidates the projection) if it isn't a valid single-match path
+	bool add(const char *expression) {
+		if (nodes.empty()) nodes.push_back(Node());
+		size_t slot = slotCount++;
+		CborPath path;
+		if (!path.compile(expression)) return fail();
+		for (auto &step : path.steps) {
+			if (step.descendant || step.kind == CborPath::Step::wildcard) return fail();
+		}
+		size_t node = 0;
+		++nodes[0].slotTotal;
+		for (auto &step : path.steps) {
+			node = childFor(node, step);
+			++nodes[node].slotTotal;
+		}
+		nodes[node].slots.push_back(slot);
+		return true;
+	}
+	bool add(const std::string &expression) {
+		return add(expression.c_str());
+	}
+	explicit operator bool() const {
+		return valid;
+	}
+	// Number of slots (one per path)
+	size_t size() const {
+		return slotCount;
+	}
+
+	// Fills `slots` (which must have space for `.size()` walkers) with the match for each path, or an `ERROR_NOT_FOUND` error - returns the number found
+	// Tags are passed through when navigating, and matches keep their tags.  If a map has duplicate keys, the first one wins.
+	size_t extract(const CborWalker &root, CborWalker *slots) const {
+		for (size_t i = 0; i < slotCount; ++i) slots[i] = {root.data, root.dataEnd, CborWalker::ERROR_NOT_FOUND};
+		if (!valid || nodes.empty()) return 0;
+		return extractNode(root, 0, slots, 0);
+	}
+	size_t extract(const CborWalker &root, std::vector<CborWalker> &slots) const {
+		slots.resize(slotCount);
+		return extract(root, slots.data());
+	}
+
+private:
+	struct KeyEdge {
+		std::string key;
+		size_t node;
+	};
+	struct IndexEdge {
+		int64_t index; // an array index (negative counts from the end), or an integer map key
+		size_t node;
+	};
+	// How a node is reached: by a key edge, an index edge, or both (a JSON Pointer segment which could be an index)
+	enum class EdgeKind : unsigned char {key, index, pointer};
+	struct Node {
+		EdgeKind kind = EdgeKind::key;
+		std::vector<KeyEdge> keys; // sorted by length, then bytes
+		std::vector<IndexEdge> indices; // sorted
+		std::vector<size_t> slots; // paths which end here
+		size_t slotTotal = 0; // paths which end here or below
+		int64_t maxIndex = -1; // the last array item worth visiting (ignoring negative indices)
+		bool negativeIndices = false;
+	};
+	std::vector<Node> nodes;
+	size_t slotCount = 0;
+	bool valid = true;
+
+	bool fail() {
+		valid = false;
+		return false;
+	}
+
+	static bool keyLess(const char *a, size_t aLength, const char *b, size_t bLength) {
+		if (aLength != bLength) return aLength < bLength;
+		return std::memcmp(a, b, aLength) < 0;
+	}
+	std::vector<KeyEdge>::iterator keyPosition(Node &node, const std::string &key) {
+		return std::lower_bound(node.keys.begin(), node.keys.end(), key, [](const KeyEdge &edge, const std::string &k){
+			return keyLess(edge.key.data(), edge.key.size(), k.data(), k.size());
+		});
+	}
+	std::vector<IndexEdge>::iterator indexPosition(Node &node, int64_t index) {
+		return std::lower_bound(node.indices.begin(), node.indices.end(), index, [](const IndexEdge &edge, int64_t i){
+			return edge.index < i;
+		});
+	}
+
+	// Follows (or adds) the edge for a step
+	size_t childFor(size_t parent, const CborPath::Step &step) {
+		bool useKey = (step.kind != CborPath::Step::position);
+		bool useIndex = (step.kind == CborPath::Step::position || step.hasIndex);
+		EdgeKind kind = (useKey && useIndex) ? EdgeKind::pointer : useKey ? EdgeKind::key : EdgeKind::index;
+		// Only share a node with steps of the same kind, since a node reached by both edges (for "/0") matches both
+		if (useKey) {
+			for (auto iter = keyPosition(nodes[parent], step.key); iter != nodes[parent].keys.end() && iter->key == step.key; ++iter) {
+				if (nodes[iter->node].kind == kind) return iter->node;
+			}
+		} else {
+			for (auto iter = indexPosition(nodes[parent], step.index); iter != nodes[parent].indices.end() && iter->index == step.index; ++iter) {
+				if (nodes[iter->node].kind == kind) return iter->node;
+			}
+		}
+		size_t child = nodes.size();
+		nodes.push_back(Node());
+		nodes[child].kind = kind;
+		Node &node = nodes[parent];
+		if (useKey) node.keys.insert(keyPosition(node, step.key), KeyEdge{step.key, child});
+		if (useIndex) {
+			node.indices.insert(indexPosition(node, step.index), IndexEdge{step.index, child});
+			node.maxIndex = std::max(node.maxIndex, step.index);
+			node.negativeIndices = node.negativeIndices || step.index < 0;
+		}
+		return child;
+	}
+
+	// Returns the number of slots filled
+	size_t extractNode(const CborWalker &item, size_t nodeIndex, CborWalker *slots, size_t depth) const {
+		const Node &node = nodes[nodeIndex];
+		size_t found = 0;
+		for (auto slot : node.slots) {
+			if (slots[slot].error()) {
+				slots[slot] = item;
+				++found;
+			}
+		}
+		size_t below = node.slotTotal - node.slots.size();
+		if (!below || depth > CBOR_WALKER_MAX_DEPTH) return found;
+		CborWalker inner = item;
+		while (inner.isTagged()) inner = inner.enter();
+
+		size_t foundBelow = 0;
+		auto visitIndex = [&](int64_t index, const CborWalker &value) {
+			auto iter = std::lower_bound(node.indices.begin(), node.indices.end(), index, [](const IndexEdge &edge, int64_t i){
+				return edge.index < i;
+			});
+			for (; iter != node.indices.end() && iter->index == index; ++iter) {
+				foundBelow += extractNode(value, iter->node, slots, depth + 1);
+			}
+		};
+		if (inner.isMap()) {
+			bool definite = inner.hasLength();
+			uint64_t count = definite ? inner.additional : 0;
+			CborWalker key = inner.enter();
+			for (uint64_t i = 0; (definite ? i < count : !key.isExit()) && foundBelow < below; ++i) {
+				if (key.error()) break;
+				CborWalker value = key.next();
+				if (value.error() || value.isExit()) break;
+				CborWalker k = (key.typeCode == CborWalker::TypeCode::tag && key.stringRefs) ? key.resolveStringRef() : key;
+				if (k.typeCode == CborWalker::TypeCode::utf8) {
+					const char *text = (const char *)k.dataNext;
+					size_t length = (size_t)k.additional;
+					auto iter = std::lower_bound(node.keys.begin(), node.keys.end(), 0, [&](const KeyEdge &edge, int){
+						return keyLess(edge.key.data(), edge.key.size(), text, length);
+					});
+					for (; iter != node.keys.end() && iter->key.size() == length && !std::memcmp(iter->key.data(), text, length); ++iter) {
+						foundBelow += extractNode(value, iter->node, slots, depth + 1);
+					}
+				} else if ((k.typeCode == CborWalker::TypeCode::integerP || k.typeCode == CborWalker::TypeCode::integerN) && k.additional <= uint64_t(std::numeric_limits<int64_t>::max())) {
+					int64_t index = (int64_t)k.additional;
+					visitIndex(k.typeCode == CborWalker::TypeCode::integerN ? -1 - index : index, value);
+				}
+				key = value.next();
+			}
+		} else if (inner.isArray() && !node.indices.empty()) {
+			bool definite = inner.hasLength();
+			uint64_t length = definite ? inner.additional : 0;
+			int64_t last = (definite && node.negativeIndices) ? (int64_t)length - 1 : node.maxIndex;
+			CborWalker child = inner.enter();
+			for (int64_t i = 0; i <= last && (definite ? (uint64_t)i < length : !child.isExit()) && foundBelow < below; ++i) {
+				if (child.error()) break;
+				visitIndex(i, child);
+				if (definite && node.negativeIndices) visitIndex(i - (int64_t)length, child);
+				++child;
+			}
+		}
+		return found + foundBelow;
+	}
+};
+
+template<class SubClassCRTP>
+struct CborWriterBase {
+	// RFC 8949 section 4.2.1 "core deterministic encoding", so equal documents always produce the same bytes: map entries are buffered and sorted by their encoded keys, floats are written in their shortest form, and indefinite-length arrays/maps/strings are written with definite lengths
+	// Set this before writing anything.  It doesn't remove duplicate keys, `addTypedArrayAligned()` doesn't pad, and stringrefs are disabled (since reference indices follow write order, which sorting changes).
+	bool deterministic = false;
+
+	void addUInt(uint64_t u) {
+		writeHead(0, u);
+		itemDone();
+	}
+	void addInt(int64_t u) {
+		if (u >= 0) {
+			writeHead(0, u);
+		} else {
+			writeHead(1, -1 - u);
+		}
+		itemDone();
+	}
+	// Writes the negative integer `-1 - magnitude`, which reaches down to -2^64 (beyond `int64_t`)
+	void addNegative(uint64_t magnitude) {
+		writeHead(1, magnitude);
+		itemDone();
+	}
+	void addTag(uint64_t u) {
+		writeHead(6, u);
+		if (bufferedFrames) frames.push_back({6, false, false, 1, 0, 0, 0});
+	}
+	void addBool(bool b) {
+		writeHead(7, 20 + b);
+		itemDone();
+	}
+	void openArray() {
+		if (deterministic) return pushBuffered(4, unknownCount);
+		emitByte(0x9F);
+	}
+	void openArray(size_t items) {
+		writeHead(4, items);
+		if (bufferedFrames) openCounted(4, items);
+	}
+	void openMap() {
+		if (deterministic) return pushBuffered(5, unknownCount);
+		emitByte(0xBF);
+	}
+	void openMap(size_t pairs) {
+		writeHead(5, pairs);
+		if (deterministic && pairs > 1) {
+			pushBuffered(5, uint64_t(pairs)*2);
+		} else if (bufferedFrames) {
+			openCounted(5, uint64_t(pairs)*2);
+		}
+	}
+	void close() {
+		indefiniteString = false;
+		if (bufferedFrames && frames.back().count == unknownCount) {
+			popFrame();
+			itemDone();
+			return;
+		}
+		emitByte(0xFF);
+	}
+
+	// Definite-length containers where the count isn't known up-front: the head is reserved now, and filled in by `close(head, count)`
+	// This needs a writer which can edit what it's written (`CborWriter` or `CborWriterFixed`).  A count which fits the reserved head is written in place, at that width (valid, but not the shortest form - `deterministic` always gives the shortest).  Only a count which outgrows it moves the contents (which breaks `addTypedArrayAligned()` alignment inside it).
+	struct PatchableHead {
+		size_t position;
+		unsigned char type, size;
+	};
+	PatchableHead openArrayPatchable(size_t expectedItems=0) {
+		return reserveHead(4, expectedItems);
+	}
+	PatchableHead openMapPatchable(size_t expectedPairs=0) {
+		return reserveHead(5, expectedPairs);
+	}
+	void close(const PatchableHead &head, size_t count) {
+		if (deterministic) return close(); // buffered, so the count is already known
+		unsigned char bytes[9];
+		size_t size = encodeHead(head.type, count, std::max<size_t>(headSize(count), head.size), bytes);
+		sub().replaceBytes(head.position, head.size, bytes, size);
+	}
+	void addBytes(const void *ptr, size_t length) {
+		addBytes((const unsigned char *)ptr, length);
+	}
+	void addBytes(const unsigned char *ptr, size_t length) {
+		if (bufferedFrames && frames.back().type == 2) return (void)arena.insert(arena.end(), ptr, ptr + length); // chunks are joined
+		if (!stringRefDepth || !addStringRef(ptr, length, false)) {
+			writeHead(2, length);
+			emitBytes(ptr, length);
+		}
+		itemDone();
+	}
+	void openBytes() {
+		indefiniteString = true;
+		if (deterministic) return pushBuffered(2, unknownCount);
+		emitByte(0x5F);
+	}
+	void addUtf8(const char *ptr, size_t length) {
+		if (bufferedFrames && frames.back().type == 3) return (void)arena.insert(arena.end(), ptr, ptr + length);
+		if (!stringRefDepth || !addStringRef((const unsigned char *)ptr, length, true)) {
+			writeHead(3, length);
+			emitBytes((const unsigned char *)ptr, length);
+		}
+		itemDone();
+	}
+	void addUtf8(const char *str) {
+		addUtf8(str, std::strlen(str));
+	}
+	void addUtf8(const std::string &str) {
+		addUtf8(str.c_str());
+	}
+#ifdef CBOR_WALKER_USE_STRING_VIEW
+	void addUtf8(const std::string_view &str) {
+		addUtf8(str.data(), str.size());
+	}
+#endif
+	void openUtf8() {
+		indefiniteString = true;
+		if (deterministic) return pushBuffered(3, unknownCount);
+		emitByte(0x7F);
+	}
+	void addNull() {
+		emitByte(0xF6);
+		itemDone();
+	}
+	void addUndefined() {
+		emitByte(0xF7);
+		itemDone();
+	}
+	void addSimple(unsigned char k) {
+		writeHead(7, k);
+		itemDone();
+	}
+
+	// Starts a stringref namespace (tag 256) for the next item, where repeated strings are written as references (tag 25) to earlier ones
+	// Call `endStringRefs()` after that item (usually an array/map) is complete.  Namespaces can be nested, and the tables are reused between namespaces.
+	// With `deterministic` set, this writes nothing and strings are written in full.
+	void beginStringRefs() {
+		if (!deterministic) addTag(256);
+		if (stringRefDepth == stringRefTables.size()) stringRefTables.emplace_back();
+		stringRefTables[stringRefDepth++].clear();
+	}
+	void endStringRefs() {
+		if (stringRefDepth) --stringRefDepth;
+	}
+	
+	// RFC 8949 section 4.1 "preferred serialization": write each float in the shortest form (16/32/64-bit) which represents it exactly, including NaN payloads
+	bool shortestFloats = false;
+
+	void addFloat(float v) {
+		writeFloat(v);
+		itemDone();
+	}
+	void addFloat(double v) {
+		writeFloat(v);
+		itemDone();
+	}
+	
+	// RFC-8746 tags for typed arrays
+	// bits: [1, 0] = log2(elementBytes),  [2] = isLittleEndian, [3, 4] = [unsigned, signed, float]
+	void addTypedArray(const uint8_t *arr, size_t length) {
+		addTag(64);
+		addBytes((const void *)arr, length);
+	}
+	void addTypedArray(const int8_t *arr, size_t length) {
+		addTag(72);
+		addBytes((const void *)arr, length);
+	}
+	void addTypedArray(const uint16_t *arr, size_t length, bool bigEndian=false) {
+		addTag(bigEndian ? 65 : 69);
+		writeTypedBlock<uint16_t>(arr, length, bigEndian);
+	}
+	void addTypedArray(const uint32_t *arr, size_t length, bool bigEndian=false) {
+		addTag(bigEndian ? 66 : 70);
+		writeTypedBlock<uint32_t>(arr, length, bigEndian);
+	}
+	void addTypedArray(const uint64_t *arr, size_t length, bool bigEndian=false) {
+		addTag(bigEndian ? 67 : 71);
+		writeTypedBlock<uint64_t>(arr, length, bigEndian);
+	}
+	// Signed ints and floats are written as their bit-patterns
+	void addTypedArray(const int16_t *arr, size_t length, bool bigEndian=false) {
+		addTag(bigEndian ? 73 : 77);
+		writeTypedBlock<uint16_t>(arr, length, bigEndian);
+	}
+	void addTypedArray(const int32_t *arr, size_t length, bool bigEndian=false) {
+		addTag(bigEndian ? 74 : 78);
+		writeTypedBlock<uint32_t>(arr, length, bigEndian);
+	}
+	void addTypedArray(const int64_t *arr, size_t length, bool bigEndian=false) {
+		addTag(bigEndian ? 75 : 79);
+		writeTypedBlock<uint64_t>(arr, length, bigEndian);
+	}
+	void addTypedArray(const float *arr, size_t length, bool bigEndian=false) {
+		addTag(bigEndian ? 81 : 85);
+		writeTypedBlock<uint32_t>(arr, length, bigEndian);
+	}
+	void addTypedArray(const double *arr, size_t length, bool bigEndian=false) {
+		addTag(bigEndian ? 82 : 86);
+		writeTypedBlock<uint64_t>(arr, length, bigEndian);
+	}
+
+	// Half-precision typed arrays (tags 80/84), rounding to nearest-even.  Values outside the half-float range become +/-Infinity.
+	void addTypedArrayFloat16(const float *arr, size_t length, bool bigEndian=false) {
+		addTag(bigEndian ? 80 : 84);
+		countStringRef(length*2);
+		writeHead(2, length*2);
+		constexpr size_t chunkLength = 2048;
+		uint16_t halves[chunkLength];
+		for (size_t start = 0; start < length; start += chunkLength) {
+			size_t count = std::min(chunkLength, length - start);
+			Float16::fromFloats(arr + start, halves, count);
+			writeTypedPayload<uint16_t>(halves, count, bigEndian);
+		}
+		itemDone();
+	}
+	// Rounds directly from `double`, so the result can differ from going via `float`
+	void addTypedArrayFloat16(const double *arr, size_t length, bool bigEndian=false) {
+		addTag(bigEndian ? 80 : 84);
+		countStringRef(length*2);
+		writeHead(2, length*2);
+		constexpr size_t chunkLength = 2048;
+		uint16_t halves[chunkLength];
+		for (size_t start = 0; start < length; start += chunkLength) {
+			size_t count = std::min(chunkLength, length - start);
+			for (size_t i = 0; i < count; ++i) halves[i] = Float16::fromDouble(arr[start + i]);
+			writeTypedPayload<uint16_t>(halves, count, bigEndian);
+		}
+		itemDone();
+	}
+
+	// Like `addTypedArray()`, but picks (valid, but not minimal) head sizes so the payload starts at a multiple of `alignment` bytes from the start of the output
+	// This can add a no-op "self-described CBOR" tag (55799) as padding.  It needs the writer to have a `.position()`, and returns false if alignment wasn't possible.
+	template<typename T>
+	bool addTypedArrayAligned(const T *arr, size_t length, bool bigEndian=false, size_t alignment=sizeof(T)) {
+		using UInt = ByteOrder::UIntFor<T>;
+		uint64_t byteLength = length*sizeof(T);
+		size_t position = sub().position();
+		static const size_t prefixSizes[] = {0, 3, 5, 9}, tagSizes[] = {2, 3, 5, 9}, bytesSizes[] = {1, 2, 3, 5, 9};
+		size_t minBytesHead = headSize(byteLength);
+		size_t bestTotal = 0, bestPrefix = 0, bestTag = 0, bestBytes = 0;
+		for (size_t prefix : prefixSizes) {
+			for (size_t tag : tagSizes) {
+				for (size_t bytes : bytesSizes) {
+					size_t total = prefix + tag + bytes;
+					if (bytes < minBytesHead || (position + total)%alignment) continue;
+					if (!bestTotal || total < bestTotal) {
+						bestTotal = total;
+						bestPrefix = prefix;
+						bestTag = tag;
+						bestBytes = bytes;
+					}
+				}
+			}
+		}
+		if (!bestTotal || deterministic) {
+			addTag(typedArrayTagFor<T>(bigEndian));
+			writeTypedBlock<UInt>(arr, length, bigEndian);
+			return false;
+		}
+		if (bestPrefix) writeHeadSized(6, 55799, bestPrefix);
+		writeHeadSized(6, typedArrayTagFor<T>(bigEndian), bestTag);
+		countStringRef(byteLength);
+		writeHeadSized(2, byteLength, bestBytes);
+		writeTypedPayload<UInt>(arr, length, bigEndian);
+		itemDone();
+		return true;
+	}
+private:
+	friend struct CborSplice;
+
+	SubClassCRTP & sub() {
+		return *(SubClassCRTP *)this;
+	}
+
+	// Output goes to the subclass, unless it's being buffered for `deterministic`
+	void emitByte(unsigned char b) {
+		if (bufferedFrames) {
+			arena.push_back(b);
+		} else {
+			sub().writeByte(b);
+		}
+	}
+	void emitBytes(const unsigned char *ptr, size_t length) {
+		if (bufferedFrames) {
+			arena.insert(arena.end(), ptr, ptr + length);
+		} else {
+			sub().writeBytes(ptr, length);
+		}
+	}
+
+	// For `deterministic`, containers are tracked (only while something is buffered, so `frames` is empty when `bufferedFrames` is 0) so we know where each map entry ends
+	static constexpr uint64_t unknownCount = ~uint64_t(0);
+	struct Frame {
+		unsigned char type; // major type: 2/3 for indefinite strings (whose chunks are joined), 4/5 for arrays/maps, 6 for tags
+		bool buffered, sorted;
+		uint64_t count, children;
+		size_t start, firstEntry; // position in `arena`, and index in `entryEnds`
+	};
+	std::vector<Frame> frames;
+	size_t bufferedFrames = 0;
+	std::vector<unsigned char> arena;
+	std::vector<size_t> entryEnds;
+	struct Span {
+		size_t start, length;
+	};
+	std::vector<Span> spans; // reused for sorting
+	std::vector<unsigned char> sortedBytes;
+
+	void itemDone() {
+		if (bufferedFrames) frameItemDone();
+	}
+	void frameItemDone() {
+		while (!frames.empty()) {
+			Frame &frame = frames.back();
+			++frame.children;
+			if (frame.sorted && !(frame.children&1)) entryEnds.push_back(arena.size());
+			if (frame.children < frame.count) return;
+			popFrame(); // the container is complete, so it's an item in its parent
+		}
+	}
+	void openCounted(unsigned char type, uint64_t count) {
+		if (!count) return itemDone();
+		frames.push_back({type, false, false, count, 0, 0, 0});
+	}
+	// Buffered until complete, so the entries can be sorted and/or the definite length written first
+	void pushBuffered(unsigned char type, uint64_t count) {
+		frames.push_back({type, true, type == 5, count, 0, arena.size(), entryEnds.size()});
+		++bufferedFrames;
+	}
+	void popFrame() {
+		Frame frame = frames.back();
+		frames.pop_back();
+		if (!frame.buffered) return;
+		--bufferedFrames;
+		if (frame.sorted) sortEntries(frame);
+		size_t length = arena.size() - frame.start;
+		unsigned char head[9];
+		size_t headLength = 0;
+		if (frame.count == unknownCount) {
+			uint64_t argument = (frame.type == 4) ? frame.children : (frame.type == 5) ? frame.children/2 : length;
+			headLength = encodeHead(frame.type, argument, headSize(argument), head);
+			if (frame.type <= 3 && stringRefDepth) stringRefTables[stringRefDepth - 1].add(arena.data() + frame.start, length, frame.type == 3);
+		}
+		if (bufferedFrames) {
+			arena.insert(arena.begin() + frame.start, head, head + headLength);
+		} else {
+			if (headLength) sub().writeBytes(head, headLength);
+			sub().writeBytes(arena.data() + frame.start, length);
+			arena.resize(frame.start);
+		}
+	}
+	// Entries are compared as whole byte sequences, which orders them by key (since no complete item is a prefix of another)
+	void sortEntries(const Frame &frame) {
+		spans.clear();
+		size_t start = frame.start;
+		bool inOrder = true;
+		for (size_t i = frame.firstEntry; i < entryEnds.size(); ++i) {
+			Span span{start, entryEnds[i] - start};
+			if (!spans.empty() && !spanLess(spans.back(), span)) inOrder = false;
+			spans.push_back(span);
+			start = entryEnds[i];
+		}
+		entryEnds.resize(frame.firstEntry);
+		if (inOrder) return;
+		std::sort(spans.begin(), spans.end(), [&](const Span &a, const Span &b){
+			return spanLess(a, b);
+		});
+		sortedBytes.clear();
+		for (auto &span : spans) {
+			sortedBytes.insert(sortedBytes.end(), arena.begin() + span.start, arena.begin() + span.start + span.length);
+		}
+		std::copy(sortedBytes.begin(), sortedBytes.end(), arena.begin() + frame.start);
+	}
+	bool spanLess(const Span &a, const Span &b) const {
+		int c = std::memcmp(arena.data() + a.start, arena.data() + b.start, std::min(a.length, b.length));
+		return c ? c < 0 : a.length < b.length;
+	}
+
+	// Previous strings in a stringref namespace: open-addressing hash table, with the string contents copied into one buffer
+	struct StringRefTable {
+		// Longer strings still take up an index, but aren't stored (so never get referenced)
+		static constexpr size_t maxStoredLength = 1024;
+
+		void clear() {
+			if (count) std::fill(entries.begin(), entries.end(), Entry{0, 0, 0, 0, false});
+			stored.clear();
+			count = 0;
+			nextIndex = 0;
+		}
+		bool find(const unsigned char *ptr, size_t length, bool utf8, uint64_t &index) const {
+			if (!count || length < 3 || length > maxStoredLength) return false;
+			uint64_t h = hash(ptr, length, utf8);
+			size_t mask = entries.size() - 1;
+			for (size_t i = (size_t)h&mask; entries[i].length; i = (i + 1)&mask) {
+				const Entry &e = entries[i];
+				if (e.hash == h && e.length == length && e.utf8 == utf8 && !std::memcmp(stored.data() + e.offset, ptr, length)) {
+					index = e.index;
+					return true;
+				}
+			}
+			return false;
+		}
+		// Call after `find()` fails, with `ptr == nullptr` for strings which can't be referenced (e.g. typed arrays)
+		void add(const unsigned char *ptr, size_t length, bool utf8) {
+			if (!CborStringRefs::worthReferencing(nextIndex, length)) return;
+			uint64_t index = nextIndex++;
+			if (!ptr || length > maxStoredLength) return;
+			if ((count + 1)*2 > entries.size()) grow();
+			Entry e{hash(ptr, length, utf8), stored.size(), length, index, utf8};
+			stored.insert(stored.end(), ptr, ptr + length);
+			insert(e);
+		}
+	private:
+		struct Entry {
+			uint64_t hash;
+			size_t offset, length; // `length == 0` for an empty slot
+			uint64_t index;
+			bool utf8;
+		};
+		std::vector<Entry> entries;
+		std::vector<unsigned char> stored;
+		size_t count = 0;
+		uint64_t nextIndex = 0;
+
+		// FNV-1a, with byte/text strings hashed differently
+		static uint64_t hash(const unsigned char *ptr, size_t length, bool utf8) {
+			uint64_t h = utf8 ? 0xCBF29CE484222325ull : 0x84222325CBF29CE4ull;
+			for (size_t i = 0; i < length; ++i) {
+				h = (h^ptr[i])*0x100000001B3ull;
+			}
+			return h;
+		}
+		void insert(const Entry &e) {
+			size_t mask = entries.size() - 1;
+			size_t i = (size_t)e.hash&mask;
+			while (entries[i].length) i = (i + 1)&mask;
+			entries[i] = e;
+			++count;
+		}
+		void grow() {
+			std::vector<Entry> old;
+			old.swap(entries);
+			entries.assign(old.size() ? old.size()*2 : 64, Entry{0, 0, 0, 0, false});
+			count = 0;
+			for (auto &e : old) {
+				if (e.length) insert(e);
+			}
+		}
+	};
+	std::vector<StringRefTable> stringRefTables;
+	size_t stringRefDepth = 0;
+	bool indefiniteString = false; // chunks of indefinite-length strings don't count as strings for stringrefs
+
+	// Writes a reference if the string has been seen before in this namespace (otherwise adds it to the table)
+	bool addStringRef(const unsigned char *ptr, size_t length, bool utf8) {
+		if (indefiniteString || deterministic) return false;
+		StringRefTable &table = stringRefTables[stringRefDepth - 1];
+		uint64_t index;
+		if (table.find(ptr, length, utf8, index)) {
+			writeHead(6, 25);
+			writeHead(0, index);
+			return true;
+		}
+		table.add(ptr, length, utf8);
+		return false;
+	}
+	// Typed arrays are byte strings, so they take up indices as well
+	void countStringRef(uint64_t length) {
+		if (stringRefDepth && !indefiniteString) stringRefTables[stringRefDepth - 1].add(nullptr, (size_t)length, false);
+	}
+
+	static size_t headSize(uint64_t argument) {
+		return (argument < 24) ? 1 : (argument < 256) ? 2 : (argument < 65536) ? 3 : (argument < 4294967296ull) ? 5 : 9;
+	}
+
+	void writeHead(unsigned char type, uint64_t argument) {
+		if (argument < 24) {
+			emitByte((type<<5)|argument);
+			return;
+		}
+		writeHeadSized(type, argument, headSize(argument));
+	}
+	// Assembles the head locally, and writes it in one go - `size` can be longer than necessary (but not shorter)
+	void writeHeadSized(unsigned char type, uint64_t argument, size_t size) {
+		unsigned char head[9];
+		size = encodeHead(type, argument, size, head);
+		emitBytes(head, size);
+	}
+	// Returns the actual size (1, 2, 3, 5 or 9)
+	static size_t encodeHead(unsigned char type, uint64_t argument, size_t size, unsigned char *head) {
+		type <<= 5;
+		switch (size) {
+		case 1:
+			head[0] = type|argument;
+			break;
+		case 2:
+			head[0] = type|24;
+			head[1] = (unsigned char)argument;
+			break;
+		case 3:
+			head[0] = type|25;
+			ByteOrder::storeBig(head + 1, uint16_t(argument));
+			break;
+		case 5:
+			head[0] = type|26;
+			ByteOrder::storeBig(head + 1, uint32_t(argument));
+			break;
+		default:
+			head[0] = type|27;
+			ByteOrder::storeBig(head + 1, argument);
+			size = 9;
+			break;
+		}
+		return size;
+	}
+	PatchableHead reserveHead(unsigned char type, size_t expected) {
+		if (deterministic) {
+			pushBuffered(type, unknownCount);
+			return {0, type, 0};
+		}
+		PatchableHead head{sub().position(), type, (unsigned char)headSize(expected)};
+		writeHeadSized(type, expected, head.size);
+		return head;
+	}
+	
+	void writeHalfFloat(uint16_t bits) {
+		unsigned char bytes[3] = {0xF9};
+		ByteOrder::storeBig(bytes + 1, bits);
+		emitBytes(bytes, 3);
+	}
+	void writeFloat(float v) {
+#ifdef CBOR_WALKER_USE_BIT_CAST
+		uint32_t vi = std::bit_cast<uint32_t>(v);
+#else
+		uint32_t vi;
+		std::memcpy(&vi, &v, 4);
+#endif
+		uint64_t narrow;
+		if ((shortestFloats || deterministic) && Float16::narrowFloat<5, 10>(vi, narrow)) {
+			writeHalfFloat(uint16_t(narrow));
+			return;
+		}
+		unsigned char bytes[5] = {0xFA};
+		ByteOrder::storeBig(bytes + 1, vi);
+		emitBytes(bytes, 5);
+	}
+	void writeFloat(double v) {
+#ifdef CBOR_WALKER_USE_BIT_CAST
+		uint64_t vi = std::bit_cast<uint64_t>(v);
+#else
+		uint64_t vi;
+		std::memcpy(&vi, &v, 8);
+#endif
+		uint64_t narrow;
+		if (shortestFloats || deterministic) {
+			if (Float16::narrowFloat<5, 10>(vi, narrow)) {
+				writeHalfFloat(uint16_t(narrow));
+				return;
+			} else if (Float16::narrowFloat<8, 23>(vi, narrow)) {
+				unsigned char bytes[5] = {0xFA};
+				ByteOrder::storeBig(bytes + 1, uint32_t(narrow));
+				emitBytes(bytes, 5);
+				return;
+			}
+		}
+		unsigned char bytes[9] = {0xFB};
+		ByteOrder::storeBig(bytes + 1, vi);
+		emitBytes(bytes, 9);
+	}
+	
+	template<typename UIntType>
+	void writeTypedBlock(const void *array, size_t length, bool bigEndian) {
+		countStringRef(length*sizeof(UIntType));
+		writeHead(2, length*sizeof(UIntType));
+		writeTypedPayload<UIntType>(array, length, bigEndian);
+		itemDone();
+	}
+	template<typename UIntType>
+	void writeTypedPayload(const void *array, size_t length, bool bigEndian) {
+		constexpr size_t B = sizeof(UIntType);
+#ifdef CBOR_WALKER_LITTLE_ENDIAN
+		bool native = !bigEndian;
+#else
+		bool native = bigEndian;
+#endif
+		if (native || B == 1) {
+			emitBytes((const unsigned char *)array, length*B);
+			return;
+		}
+		// Byte-swap in chunks, so the subclass gets a few large writes
+		constexpr size_t chunkLength = 4096/B;
+		unsigned char chunk[chunkLength*B];
+		for (size_t start = 0; start < length; start += chunkLength) {
+			size_t count = std::min(chunkLength, length - start);
+			ByteOrder::copySwapped<UIntType>(chunk, (const unsigned char *)array + start*B, count);
+			emitBytes(chunk, count*B);
+		}
+	}
+};
+
+struct CborWriter : public CborWriterBase<CborWriter> {
+	CborWriter(std::vector<unsigned char> &bytes, size_t reserveBytes=0) : bytes(bytes) {
+		if (reserveBytes) bytes.reserve(bytes.size() + reserveBytes);
+	}
+
+	size_t position() const {
+		return bytes.size();
+	}
+	
+private:
+	friend struct CborWriterBase<CborWriter>;
+
+	std::vector<unsigned char> &bytes;
+	void writeByte(unsigned char b) {
+		bytes.push_back(b);
+	}
+	void replaceBytes(size_t position, size_t oldLength, const unsigned char *ptr, size_t length) {
+		if (length > oldLength) {
+			bytes.insert(bytes.begin() + position, length - oldLength, 0);
+		} else if (length < oldLength) {
+			bytes.erase(bytes.begin() + position, bytes.begin() + position + (oldLength - length));
+		}
+		std::memcpy(bytes.data() + position, ptr, length);
+	}
+	void writeBytes(const unsigned char *ptr, size_t length) {
+		// `vector::insert()` has a lot of overhead for short writes like heads
+		if (length <= 16) {
+			for (size_t i = 0; i < length; ++i) bytes.push_back(ptr[i]);
+		} else {
+			bytes.insert(bytes.end(), ptr, ptr + length);
+		}
 	}
 };
 
@@ -995,14 +3961,1297 @@ struct CborWriterStream : public CborWriterBase<CborWriterStream> {
 	CborWriterStream(std::ostream &output) : output(output) {}
 	
 private:
-	friend struct CborWriterBase<CborWriterStream>;
+	friend struct CborWriterBase<CborWriterStream>;
+
+	std::ostream &output;
+	void writeByte(unsigned char b) {
+		output.put((char)b);
+	}
+	void writeBytes(const unsigned char *ptr, size_t length) {
+		output.write((const char *)ptr, length);
+	}
+};
+
+// Appends to a list of large blocks, so growing never copies what's already been written
+struct CborWriterChunked : public CborWriterBase<CborWriterChunked> {
+	CborWriterChunked(size_t blockSize=65536) : blockSize(blockSize < 16 ? 16 : blockSize) {}
+	CborWriterChunked(const CborWriterChunked &other) = delete;
+
+	size_t size() const {
+		return completeBytes + (pos - blockStart());
+	}
+	size_t position() const {
+		return size();
+	}
+	// Calls `fn(const unsigned char *ptr, size_t length)` for each non-empty block, in order
+	template<class Fn>
+	void forEachBlock(Fn &&fn) const {
+		for (size_t i = 0; i < blocks.size(); ++i) {
+			size_t length = (i + 1 < blocks.size()) ? blockLengths[i] : (size_t)(pos - blocks[i].data());
+			if (length) fn((const unsigned char *)blocks[i].data(), length);
+		}
+	}
+	void copyTo(unsigned char *output) const {
+		forEachBlock([&](const unsigned char *ptr, size_t length){
+			std::memcpy(output, ptr, length);
+			output += length;
+		});
+	}
+	std::vector<unsigned char> toVector() const {
+		std::vector<unsigned char> result(size());
+		if (!result.empty()) copyTo(result.data());
+		return result;
+	}
+	void clear() {
+		if (blocks.size() > 1) blocks.resize(1);
+		blockLengths.clear();
+		completeBytes = 0;
+		pos = blocks.empty() ? nullptr : blocks.back().data();
+		end = blocks.empty() ? nullptr : pos + blocks.back().size();
+	}
+
+private:
+	friend struct CborWriterBase<CborWriterChunked>;
+
+	size_t blockSize;
+	std::vector<std::vector<unsigned char>> blocks;
+	std::vector<size_t> blockLengths; // lengths of all complete blocks
+	size_t completeBytes = 0;
+	unsigned char *pos = nullptr, *end = nullptr;
+
+	const unsigned char * blockStart() const {
+		return blocks.empty() ? nullptr : blocks.back().data();
+	}
+	void newBlock(size_t minSize) {
+		if (!blocks.empty()) {
+			size_t length = pos - blocks.back().data();
+			blockLengths.push_back(length);
+			completeBytes += length;
+		}
+		blocks.emplace_back(std::max(blockSize, minSize));
+		pos = blocks.back().data();
+		end = pos + blocks.back().size();
+	}
+
+	void writeByte(unsigned char b) {
+		if (pos == end) newBlock(1);
+		*(pos++) = b;
+	}
+	void writeBytes(const unsigned char *ptr, size_t length) {
+		if ((size_t)(end - pos) < length) {
+			// Fill the current block first, unless it's a small write (e.g. a head) which we keep contiguous
+			if (length > 16 && pos != end) {
+				size_t partial = end - pos;
+				std::memcpy(pos, ptr, partial);
+				pos += partial;
+				ptr += partial;
+				length -= partial;
+			}
+			newBlock(length);
+		}
+		std::memcpy(pos, ptr, length);
+		pos += length;
+	}
+};
+
+// Writes into a caller-supplied buffer, never allocating or throwing
+// If the buffer is too small, `.overflow()` is set and nothing more is written, but `.bytesNeeded()` keeps counting so you can retry with a larger buffer
+struct CborWriterFixed : public CborWriterBase<CborWriterFixed> {
+	CborWriterFixed(unsigned char *buffer, size_t capacity) : buffer(buffer), bufferCapacity(capacity) {}
+	template<size_t N>
+	CborWriterFixed(unsigned char (&buffer)[N]) : CborWriterFixed(buffer, N) {}
+
+	// Start again (optionally with a different buffer)
+	void reset() {
+		written = needed = 0;
+		overflowed = false;
+	}
+	void reset(unsigned char *newBuffer, size_t capacity) {
+		buffer = newBuffer;
+		bufferCapacity = capacity;
+		reset();
+	}
+
+	bool overflow() const {
+		return overflowed;
+	}
+	// Bytes actually written - if there's been an overflow, this is only the part before the failed write
+	size_t size() const {
+		return written;
+	}
+	// Total bytes for everything written so far, including anything which didn't fit
+	size_t bytesNeeded() const {
+		return needed;
+	}
+	size_t capacity() const {
+		return bufferCapacity;
+	}
+	size_t position() const {
+		return needed;
+	}
+	const unsigned char * data() const {
+		return buffer;
+	}
+
+private:
+	friend struct CborWriterBase<CborWriterFixed>;
+
+	unsigned char *buffer;
+	size_t bufferCapacity;
+	size_t written = 0, needed = 0;
+	bool overflowed = false;
+
+	void writeByte(unsigned char b) {
+		++needed;
+		if (overflowed) return;
+		if (written < bufferCapacity) {
+			buffer[written++] = b;
+		} else {
+			overflowed = true;
+		}
+	}
+	void writeBytes(const unsigned char *ptr, size_t length) {
+		needed += length;
+		if (overflowed) return;
+		if (bufferCapacity - written >= length) {
+			std::memcpy(buffer + written, ptr, length);
+			written += length;
+		} else {
+			overflowed = true;
+		}
+	}
+	void replaceBytes(size_t position, size_t oldLength, const unsigned char *ptr, size_t length) {
+		needed = needed - oldLength + length;
+		if (overflowed) return;
+		if (length > oldLength && bufferCapacity - written < length - oldLength) {
+			overflowed = true;
+			return;
+		}
+		std::memmove(buffer + position + length, buffer + position + oldLength, written - position - oldLength);
+		std::memcpy(buffer + position, ptr, length);
+		written = written - oldLength + length;
+	}
+};
+
+// Buffers output and writes it to the stream in large blocks (flushed when full, on `.flush()` and on destruction)
+struct CborWriterBufferedStream : public CborWriterBase<CborWriterBufferedStream> {
+	CborWriterBufferedStream(std::ostream &output, size_t bufferSize=65536) : output(output), buffer(bufferSize < 16 ? 16 : bufferSize) {}
+	CborWriterBufferedStream(const CborWriterBufferedStream &other) = delete;
+	~CborWriterBufferedStream() {
+		flush();
+	}
+
+	void flush() {
+		if (bufferUsed) output.write((const char *)buffer.data(), bufferUsed);
+		flushedBytes += bufferUsed;
+		bufferUsed = 0;
+	}
+	// Total bytes written (including those still in the buffer)
+	size_t position() const {
+		return flushedBytes + bufferUsed;
+	}
+
+private:
+	friend struct CborWriterBase<CborWriterBufferedStream>;
+
+	std::ostream &output;
+	std::vector<unsigned char> buffer;
+	size_t bufferUsed = 0, flushedBytes = 0;
+
+	void writeByte(unsigned char b) {
+		if (bufferUsed == buffer.size()) flush();
+		buffer[bufferUsed++] = b;
+	}
+	void writeBytes(const unsigned char *ptr, size_t length) {
+		if (buffer.size() - bufferUsed < length) {
+			flush();
+			// Large writes skip the buffer
+			if (length >= buffer.size()) {
+				output.write((const char *)ptr, length);
+				flushedBytes += length;
+				return;
+			}
+		}
+		std::memcpy(buffer.data() + bufferUsed, ptr, length);
+		bufferUsed += length;
+	}
+};
+
+// Edits to an encoded buffer (replacing, inserting or removing items) which produce a new buffer without re-encoding: unchanged bytes are copied, and only the heads of definite-length containers whose counts change are rewritten
+// Edits are positioned using walkers over the original buffer, which has to outlive the splice.  Items read with a `TaggedCborWalker` keep their tags when replaced, but not when removed.
+// Matching edits to their containers walks the items up to the last edit (or the end of any container being appended to), but nothing after that.
+struct CborSplice {
+	CborSplice(const unsigned char *data, size_t length) : dataStart(data), dataEnd(data + length) {}
+	CborSplice(const std::vector<unsigned char> &vector) : CborSplice(vector.data(), vector.size()) {}
+
+	// Replaces an item with encoded CBOR
+	bool replace(const CborWalker &item, const unsigned char *cbor, size_t length) {
+		return addEdit(edits, Edit::replace, item, cbor, length, 0);
+	}
+	bool replace(const CborWalker &item, const std::vector<unsigned char> &cbor) {
+		return replace(item, cbor.data(), cbor.size());
+	}
+	// Removes an array item, or a map entry (given its key)
+	bool remove(const CborWalker &item) {
+		return addEdit(edits, Edit::remove, item, nullptr, 0, 1);
+	}
+	// Inserts encoded items before an array item, or entries before a map key - `count` is the number of items/entries
+	bool insertBefore(const CborWalker &item, const unsigned char *cbor, size_t length, size_t count=1) {
+		return addEdit(edits, Edit::insert, item, cbor, length, count);
+	}
+	bool insertBefore(const CborWalker &item, const std::vector<unsigned char> &cbor, size_t count=1) {
+		return insertBefore(item, cbor.data(), cbor.size(), count);
+	}
+	// Adds encoded items to the end of an array, or entries to the end of a map
+	bool append(const CborWalker &container, const unsigned char *cbor, size_t length, size_t count=1) {
+		if (!container.isArray() && !container.isMap()) return fail(CborWalker::ERROR_METHOD_TYPE_MISMATCH);
+		return addEdit(appends, Edit::append, container, cbor, length, count);
+	}
+	bool append(const CborWalker &container, const std::vector<unsigned char> &cbor, size_t count=1) {
+		return append(container, cbor.data(), cbor.size(), count);
+	}
+
+	void clear() {
+		edits.clear();
+		appends.clear();
+		ranges.clear();
+		bytes.clear();
+		editBytes = 0;
+		errorCode = 0;
+	}
+	uint64_t error() const {
+		return errorCode;
+	}
+
+	// Writes the edited buffer into `output` (which can't be the original)
+	bool apply(std::vector<unsigned char> &output) {
+		if (!resolve()) return false;
+		size_t total = dataEnd - dataStart;
+		for (auto &range : ranges) total += range.length - (range.end - range.start);
+		output.clear();
+		output.reserve(total);
+		const unsigned char *copied = dataStart;
+		for (auto &range : ranges) {
+			output.insert(output.end(), copied, range.start);
+			output.insert(output.end(), bytes.data() + range.offset, bytes.data() + range.offset + range.length);
+			copied = range.end;
+		}
+		output.insert(output.end(), copied, dataEnd);
+		return true;
+	}
+	std::vector<unsigned char> apply() {
+		std::vector<unsigned char> result;
+		apply(result);
+		return result;
+	}
+	// Overwrites the original buffer if no edit (including re-encoded heads) changes the size - otherwise returns false and leaves it alone
+	bool applyInPlace(unsigned char *buffer) {
+		if (buffer != dataStart) return fail(CborWalker::ERROR_NOT_FOUND);
+		if (!resolve()) return false;
+		for (auto &range : ranges) {
+			if (range.length != size_t(range.end - range.start)) return false;
+		}
+		for (auto &range : ranges) {
+			if (range.length) std::memcpy(buffer + (range.start - dataStart), bytes.data() + range.offset, range.length);
+		}
+		return true;
+	}
+
+private:
+	struct Edit {
+		// Also the order for edits at the same position
+		enum Kind : unsigned char {insert, replace, remove, append};
+		Kind kind;
+		const unsigned char *item; // or the container, for appends
+		size_t offset, length; // into `bytes`
+		uint64_t count;
+	};
+	// A resolved edit: source bytes to skip, and what to write instead
+	struct Range {
+		const unsigned char *start, *end;
+		size_t offset, length;
+	};
+
+	const unsigned char *dataStart, *dataEnd;
+	std::vector<Edit> edits, appends;
+	std::vector<Range> ranges;
+	std::vector<unsigned char> bytes; // bytes for the edits, followed by re-encoded heads
+	size_t editBytes = 0, nextEdit = 0, nextAppend = 0, openAppends = 0;
+	uint64_t errorCode = 0;
+
+	bool fail(uint64_t code) {
+		if (!errorCode) errorCode = code;
+		return false;
+	}
+
+	bool addEdit(std::vector<Edit> &list, typename Edit::Kind kind, const CborWalker &item, const unsigned char *cbor, size_t length, uint64_t count) {
+		if (item.error() || item.data < dataStart || item.data >= dataEnd) return fail(CborWalker::ERROR_NOT_FOUND);
+		bytes.resize(editBytes);
+		bytes.insert(bytes.end(), cbor, cbor + length);
+		list.push_back({kind, item.data, editBytes, length, count});
+		editBytes += length;
+		return true;
+	}
+
+	// All edits are matched, and no containers are waiting for their ends (for appends)
+	bool finished() const {
+		return nextEdit == edits.size() && nextAppend == appends.size() && !openAppends;
+	}
+	// Is there an unmatched edit before this position?
+	bool skippedEdit(const unsigned char *position) const {
+		return (nextEdit < edits.size() && edits[nextEdit].item < position) || (nextAppend < appends.size() && appends[nextAppend].item < position);
+	}
+
+	// A single pass over the items up to the last edit, which matches each edit to its container and lists the source ranges to replace
+	bool resolve() {
+		if (errorCode) return false;
+		ranges.clear();
+		bytes.resize(editBytes);
+		std::stable_sort(edits.begin(), edits.end(), [](const Edit &a, const Edit &b){
+			return (a.item != b.item) ? a.item < b.item : a.kind < b.kind;
+		});
+		std::stable_sort(appends.begin(), appends.end(), [](const Edit &a, const Edit &b){
+			return a.item < b.item;
+		});
+		nextEdit = nextAppend = openAppends = 0;
+		// The top level is a sequence of items, with no head
+		CborWalker item(dataStart, dataEnd);
+		int64_t delta = 0;
+		if (!resolveChildren(item, nullptr, ~uint64_t(0), false, 0, delta)) return false;
+		if (!finished()) return fail(CborWalker::ERROR_NOT_FOUND);
+		// Heads were added after the edits inside their containers
+		std::stable_sort(ranges.begin(), ranges.end(), [](const Range &a, const Range &b){
+			return a.start < b.start;
+		});
+		return true;
+	}
+
+	// Moves `item` past itself (unless everything is `finished()` before then)
+	bool resolveItem(CborWalker &item, size_t depth) {
+		using TypeCode = CborWalker::TypeCode;
+		if (depth > CBOR_WALKER_MAX_DEPTH) return fail(CborWalker::ERROR_TOO_DEEP);
+		int64_t delta = 0;
+		switch (item.typeCode) {
+		case TypeCode::tag: {
+			CborWalker child = item.enter();
+			if (!resolveChildren(child, item.data, 1, false, depth, delta)) return false;
+			item = child;
+			return true;
+		}
+		case TypeCode::array:
+		case TypeCode::map:
+		case TypeCode::indefiniteArray:
+		case TypeCode::indefiniteMap: {
+			bool isMap = item.isMap(), definite = item.hasLength();
+			size_t firstAppend = nextAppend;
+			while (nextAppend < appends.size() && appends[nextAppend].item == item.data) ++nextAppend;
+			openAppends += nextAppend - firstAppend;
+			CborWalker child = item.enter();
+			if (!resolveChildren(child, item.data, definite ? item.additional*(isMap ? 2 : 1) : ~uint64_t(0), isMap, depth, delta)) return false;
+			// Any appends stop us finishing early, so `child` is at the end
+			for (size_t i = firstAppend; i < nextAppend && appends[i].item == item.data; ++i) {
+				const Edit &edit = appends[i];
+				ranges.push_back({child.data, child.data, edit.offset, edit.length});
+				delta += edit.count;
+				--openAppends;
+			}
+			if (delta && definite) {
+				uint64_t count = item.additional + delta;
+				unsigned char head[9];
+				size_t headLength = CborWriter::encodeHead(isMap ? 5 : 4, count, CborWriter::headSize(count), head);
+				ranges.push_back({item.data, item.dataNext, bytes.size(), headLength});
+				bytes.insert(bytes.end(), head, head + headLength);
+			}
+			item = definite ? child : child.nextBasic();
+			return true;
+		}
+		default:
+			item = item.next();
+			return true;
+		}
+	}
+
+	// `count` is ~0 for indefinite containers (or the top level, when `parent` is null), and `delta` collects the change in items (or entries, for maps)
+	bool resolveChildren(CborWalker &child, const unsigned char *parent, uint64_t count, bool isMap, size_t depth, int64_t &delta) {
+		using TypeCode = CborWalker::TypeCode;
+		bool definite = (count != ~uint64_t(0));
+		for (uint64_t i = 0; !finished(); ++i) {
+			if (definite ? i >= count : (parent ? child.isExit() : child.atEnd())) break;
+			if (child.error()) return fail(child.error());
+
+			CborWalker inner = child; // a `TaggedCborWalker` points after the tags
+			while (inner.typeCode == TypeCode::tag) inner = inner.enter();
+			const unsigned char *start = child.data, *removedEnd = nullptr;
+			bool isKey = isMap && !(i&1);
+
+			// Edits to this item
+			while (nextEdit < edits.size() && !removedEnd) {
+				const Edit &edit = edits[nextEdit];
+				if (edit.item != start && (edit.item != inner.data || edit.kind == Edit::replace)) break;
+				if (edit.kind != Edit::replace && isMap && !isKey) return fail(CborWalker::ERROR_METHOD_TYPE_MISMATCH); // entries are added/removed by key
+				if (edit.kind == Edit::insert) {
+					ranges.push_back({start, start, edit.offset, edit.length});
+					delta += edit.count;
+				} else {
+					CborWalker after = child.next();
+					if (edit.kind == Edit::remove) {
+						if (isKey && !after.error()) {
+							after = after.next();
+							++i;
+						}
+						--delta;
+					}
+					if (after.error() && !after.atEnd()) return fail(after.error());
+					removedEnd = after.data;
+					ranges.push_back({start, removedEnd, edit.offset, edit.length});
+					child = after;
+				}
+				++nextEdit;
+			}
+			if (removedEnd) {
+				if (skippedEdit(removedEnd)) return fail(CborWalker::ERROR_INVALID_VALUE); // overlapping edits
+				continue;
+			}
+			if (finished()) break;
+			// Look for edits inside the item
+			if (!resolveItem(child, depth + 1)) return false;
+			if (finished()) break;
+			if (skippedEdit(child.data)) return fail(CborWalker::ERROR_NOT_FOUND); // not the start of an item
+		}
+		return true;
+	}
+};
+
+// Struct binding: a struct lists its fields in a method like this:
+//	template<class Fields>
+//	void cborFields(Fields &fields) {
+//		fields("x", x);
+//		fields("name", name);
+//		fields(4, kid); // integer keys (e.g. for COSE/CWT) are smaller, and quicker to match
+//	}
+// and can then be written with `encode(writer, value)` (as a map) and read with `decode(cbor, value)`.
+// Fields can be bools, numbers, `std::string`s, `std::vector`s (numeric ones are written as typed arrays) or other bound structs.
+struct CborBinding {
+	template<class T>
+	struct HasFields {
+		struct Probe {
+			template<class K, class V>
+			void operator()(const K &, V &) {}
+		};
+		template<class C>
+		static char test(decltype(std::declval<C &>().cborFields(std::declval<Probe &>())) *);
+		template<class C>
+		static long test(...);
+		static constexpr bool value = sizeof(test<T>(nullptr)) == 1;
+	};
+	// Vectors of these are written as typed arrays
+	template<class T>
+	struct IsTypedArrayElement {
+		static constexpr bool value = std::is_arithmetic<T>::value && !std::is_same<T, bool>::value && sizeof(T) <= 8 && (!std::is_floating_point<T>::value || sizeof(T) >= 4);
+	};
+	// The fixed-width type with the same representation, so we pick the right `addTypedArray()` overload
+	template<class T>
+	using FixedFor = typename std::conditional<std::is_floating_point<T>::value,
+		typename std::conditional<sizeof(T) == 4, float, double>::type,
+		typename std::conditional<std::is_signed<T>::value,
+			typename std::conditional<sizeof(T) == 1, int8_t, typename std::conditional<sizeof(T) == 2, int16_t, typename std::conditional<sizeof(T) == 4, int32_t, int64_t>::type>::type>::type,
+			typename std::conditional<sizeof(T) == 1, uint8_t, typename std::conditional<sizeof(T) == 2, uint16_t, typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type>::type>::type
+		>::type
+	>::type;
+
+	template<class Writer>
+	static void write(Writer &writer, bool value) {
+		writer.addBool(value);
+	}
+	template<class Writer, typename T>
+	static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type write(Writer &writer, T value) {
+		writer.addInt(value);
+	}
+	template<class Writer, typename T>
+	static typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value && !std::is_same<T, bool>::value>::type write(Writer &writer, T value) {
+		writer.addUInt(value);
+	}
+	template<class Writer, typename T>
+	static typename std::enable_if<std::is_floating_point<T>::value>::type write(Writer &writer, T value) {
+		if (sizeof(T) == 4) {
+			writer.addFloat(float(value));
+		} else {
+			writer.addFloat(double(value));
+		}
+	}
+	template<class Writer>
+	static void write(Writer &writer, const std::string &value) {
+		writer.addUtf8(value.data(), value.size());
+	}
+	template<class Writer, typename T>
+	static typename std::enable_if<IsTypedArrayElement<T>::value>::type write(Writer &writer, const std::vector<T> &value) {
+		writer.addTypedArray((const FixedFor<T> *)value.data(), value.size());
+	}
+	template<class Writer, typename T>
+	static typename std::enable_if<!IsTypedArrayElement<T>::value>::type write(Writer &writer, const std::vector<T> &value) {
+		writer.openArray(value.size());
+		for (const T &item : value) write(writer, item);
+	}
+	template<class Writer, class T>
+	static typename std::enable_if<HasFields<T>::value>::type write(Writer &writer, const T &value) {
+		FieldCounter counter;
+		T &mutableValue = const_cast<T &>(value); // `cborFields()` isn't `const` because it's also used for reading, but the encoder doesn't modify anything
+		mutableValue.cborFields(counter);
+		writer.openMap(counter.count);
+		FieldWriter<Writer> fieldWriter{writer};
+		mutableValue.cborFields(fieldWriter);
+	}
+
+	// Returns false if the type doesn't match (leaving the value unchanged), or a bound struct's fields didn't all match
+	template<typename T>
+	static bool read(const CborWalker &cbor, T &value) {
+		if (!cbor.getStringRefs()) { // stringrefs are always resolved, even if the caller didn't attach a table
+			CborStringRefs refs;
+			return read(cbor.withStringRefs(refs), value);
+		}
+		bool ok = true;
+		CborWalker end = readItem(cbor, value, ok);
+		return ok && (!end.error() || end.atEnd());
+	}
+private:
+	struct FieldCounter {
+		size_t count = 0;
+		template<class K, class V>
+		void operator()(const K &, V &) {
+			++count;
+		}
+	};
+	template<class Writer>
+	struct FieldWriter {
+		Writer &writer;
+		template<size_t N, class V>
+		void operator()(const char (&name)[N], V &value) {
+			writer.addUtf8(name, N - 1);
+			write(writer, (const V &)value);
+		}
+		template<typename Int, class V>
+		typename std::enable_if<std::is_integral<Int>::value>::type operator()(Int key, V &value) {
+			write(writer, key);
+			write(writer, (const V &)value);
+		}
+	};
+	// Checks the key against each field name (comparing the compile-time length first) or integer key
+	struct FieldReader {
+		const CborWalker &value;
+		bool &ok;
+		bool textKey, intKey, negative = false;
+		const char *text = nullptr;
+		size_t textLength = 0;
+		uint64_t magnitude = 0; // the integer key is either this, or (-1 - magnitude)
+		bool found = false;
+		CborWalker end;
+		FieldReader(const CborWalker &key, const CborWalker &value, bool &ok) : value(value), ok(ok), textKey(key.isUtf8() && key.hasLength()), intKey(key.isInt()) {
+			if (textKey) {
+				text = (const char *)key.bytes();
+				textLength = key.length();
+			} else if (intKey) {
+				negative = key.isNegativeInt();
+				magnitude = negative ? ~(uint64_t)key : (uint64_t)key;
+			}
+		}
 
-	std::ostream &output;
-	void writeByte(unsigned char b) {
-		output.put((char)b);
+		template<size_t N, class V>
+		void operator()(const char (&name)[N], V &field) {
+			if (found || !textKey || textLength != N - 1 || std::memcmp(text, name, N - 1)) return;
+			found = true;
+			end = readItem(value, field, ok);
+		}
+		template<typename Int, class V>
+		typename std::enable_if<std::is_integral<Int>::value>::type operator()(Int key, V &field) {
+			bool keyNegative = std::is_signed<Int>::value && (int64_t)key < 0;
+			uint64_t keyMagnitude = keyNegative ? (uint64_t)(-1 - (int64_t)key) : (uint64_t)key;
+			if (found || !intKey || negative != keyNegative || magnitude != keyMagnitude) return;
+			found = true;
+			end = readItem(value, field, ok);
+		}
+	};
+
+	// Each of these reads an item and returns a walker for what comes after it, so containers are only walked once
+	// (Moving on uses the plain walker, since a `TaggedCborWalker` for a stringref points at the string it refers to)
+	template<typename T>
+	static typename std::enable_if<!HasFields<T>::value, CborWalker>::type readItem(const CborWalker &cbor, T &value, bool &ok) {
+		if (cbor.isTagged()) {
+			TaggedCborWalker untagged(cbor);
+			if (!readValue(untagged, value)) ok = false;
+			return cbor.next();
+		}
+		if (!readValue(cbor, value)) ok = false;
+		return cbor.next();
 	}
-	void writeBytes(const unsigned char *ptr, size_t length) {
-		output.write((const char *)ptr, length);
+	// Numeric vectors can also be typed arrays
+	template<typename T>
+	static CborWalker readItem(const CborWalker &cbor, std::vector<T> &value, bool &ok) {
+		TaggedCborWalker tagged(cbor);
+		if (tagged.isTypedArray()) {
+			if (!readTypedArray(tagged, value, std::integral_constant<bool, IsTypedArrayElement<T>::value>())) ok = false;
+			return cbor.next();
+		} else if (!tagged.isArray()) {
+			ok = false;
+			return cbor.next();
+		}
+		std::vector<T> result;
+		bool itemsOk = true;
+		CborWalker item = tagged.CborWalker::enter();
+		if (tagged.hasLength()) {
+			size_t count = tagged.length();
+			result.reserve(std::min<size_t>(count, 65536));
+			while (result.size() < count && !item.error()) {
+				T element{};
+				item = readItem(item, element, itemsOk);
+				result.push_back(std::move(element));
+			}
+			itemsOk = itemsOk && result.size() == count;
+		} else {
+			while (!item.error() && !item.isExit()) {
+				T element{};
+				item = readItem(item, element, itemsOk);
+				result.push_back(std::move(element));
+			}
+			itemsOk = itemsOk && item.isExit();
+			item = item.next(); // move past the exit
+		}
+		if (itemsOk) {
+			value = std::move(result);
+		} else {
+			ok = false;
+		}
+		return item;
+	}
+	template<class T>
+	static typename std::enable_if<HasFields<T>::value, CborWalker>::type readItem(const CborWalker &cbor, T &value, bool &ok) {
+		CborWalker map = cbor.isTagged() ? TaggedCborWalker(cbor) : cbor;
+		if (!map.isMap()) {
+			ok = false;
+			return cbor.next();
+		}
+		bool definite = map.hasLength();
+		size_t remaining = definite ? map.length() : ~size_t(0);
+		CborWalker item = map.enter();
+		while (remaining && !item.error() && !item.isExit()) {
+			CborWalker fieldValue = item.next();
+			if (fieldValue.error() || fieldValue.isExit()) break;
+			FieldReader reader(item.resolveStringRef(), fieldValue, ok);
+			if (reader.textKey || reader.intKey) value.cborFields(reader);
+			item = reader.found ? reader.end : fieldValue.next(); // unknown keys are ignored
+			--remaining;
+		}
+		if (definite ? remaining > 0 : !item.isExit()) {
+			ok = false;
+			return item;
+		}
+		return definite ? item : item.next();
+	}
+
+	static bool readValue(const CborWalker &cbor, bool &value) {
+		if (!cbor.isBool()) return false;
+		value = (bool)cbor;
+		return true;
+	}
+	template<typename T>
+	static typename std::enable_if<std::is_integral<T>::value, bool>::type readValue(const CborWalker &cbor, T &value) {
+		if (!cbor.isInt()) return false;
+		if (cbor.isNegativeInt()) {
+			uint64_t magnitude = ~(uint64_t)cbor; // the value is (-1 - magnitude)
+			if (!std::is_signed<T>::value || magnitude > uint64_t(INT64_MAX)) return false;
+			int64_t v = -1 - int64_t(magnitude);
+			if (v < (int64_t)std::numeric_limits<T>::min()) return false;
+			value = (T)v;
+		} else {
+			uint64_t v = (uint64_t)cbor;
+			if (v > (uint64_t)std::numeric_limits<T>::max()) return false;
+			value = (T)v;
+		}
+		return true;
+	}
+	template<typename T>
+	static typename std::enable_if<std::is_floating_point<T>::value, bool>::type readValue(const CborWalker &cbor, T &value) {
+		if (!cbor.isNumber()) return false;
+		value = (T)(double)cbor;
+		return true;
+	}
+	static bool readValue(const CborWalker &cbor, std::string &value) {
+		if (cbor.isUtf8() && cbor.hasLength()) {
+			value.assign((const char *)cbor.bytes(), cbor.length());
+			return true;
+		} else if (cbor.isUtf8()) {
+			std::string joined;
+			CborWalker end = cbor.forEach([&](const CborWalker &chunk, size_t){
+				joined.append((const char *)chunk.bytes(), chunk.length());
+			});
+			if (end.error() && !end.atEnd()) return false;
+			value = std::move(joined);
+			return true;
+		}
+		return false;
+	}
+	template<typename T>
+	static bool readTypedArray(const TaggedCborWalker &cbor, std::vector<T> &value, std::true_type) {
+		std::vector<T> result(cbor.typedArrayLength());
+		if (cbor.readTypedArray(result) != result.size()) return false;
+		value = std::move(result);
+		return true;
+	}
+	template<typename T>
+	static bool readTypedArray(const TaggedCborWalker &, std::vector<T> &, std::false_type) {
+		return false;
+	}
+};
+
+template<class Writer, class T>
+void encode(Writer &writer, const T &value) {
+	CborBinding::write(writer, value);
+}
+template<class T>
+bool decode(const CborWalker &cbor, T &value) {
+	return CborBinding::read(cbor, value);
+}
+
+// A node in a `CborDocument`: children are a linked list (map children alternate key/value), and strings point at their bytes without owning them
+struct CborNode {
+	// Mirrors the walker's types (half-precision floats become `float32`)
+	enum class Type : unsigned char {
+		integerP, integerN, bytes, utf8, array, map, tag, simple, float32, float64
+	};
+
+	explicit CborNode(Type type) : type(type), childCount(0), integer(0), firstChild(nullptr), lastChild(nullptr), nextSibling(nullptr) {}
+
+	Type nodeType() const {
+		return type;
+	}
+	bool isInt() const {
+		return type == Type::integerP || type == Type::integerN;
+	}
+	bool isNegativeInt() const {
+		return type == Type::integerN;
+	}
+	bool isFloat() const {
+		return type == Type::float32 || type == Type::float64;
+	}
+	bool isNumber() const {
+		return isInt() || isFloat();
+	}
+	bool isSimple() const {
+		return type == Type::simple;
+	}
+	bool isBool() const {
+		return type == Type::simple && (integer == 20 || integer == 21);
+	}
+	bool isNull() const {
+		return type == Type::simple && integer == 22;
+	}
+	bool isUndefined() const {
+		return type == Type::simple && integer == 23;
+	}
+	bool isBytes() const {
+		return type == Type::bytes;
+	}
+	bool isUtf8() const {
+		return type == Type::utf8;
+	}
+	bool isArray() const {
+		return type == Type::array;
+	}
+	bool isMap() const {
+		return type == Type::map;
+	}
+	bool isTagged() const {
+		return type == Type::tag;
+	}
+
+	int64_t asInt() const {
+		switch (type) {
+		case Type::integerP:
+			return (int64_t)integer;
+		case Type::integerN:
+			return -1 - (int64_t)integer;
+		case Type::float32:
+			return (int64_t)float32;
+		case Type::float64:
+			return (int64_t)float64;
+		default:
+			return 0;
+		}
+	}
+	uint64_t asUInt() const {
+		return type == Type::integerP ? integer : (uint64_t)asInt();
+	}
+	double asDouble() const {
+		switch (type) {
+		case Type::integerP:
+			return (double)integer;
+		case Type::integerN:
+			return -1 - (double)integer;
+		case Type::float32:
+			return float32;
+		case Type::float64:
+			return float64;
+		default:
+			return 0;
+		}
+	}
+	bool asBool() const {
+		return isSimple() && integer == 21;
+	}
+	// Tag number, or simple value
+	uint64_t tag() const {
+		return (type == Type::tag || type == Type::simple) ? integer : 0;
+	}
+	const unsigned char * bytes() const {
+		return (type == Type::bytes || type == Type::utf8) ? data : nullptr;
+	}
+	// Bytes in a string, items in an array, or pairs in a map
+	size_t length() const {
+		return (type == Type::map) ? childCount/2 : childCount;
+	}
+	size_t size() const {
+		return length();
+	}
+	std::string utf8() const {
+		if (type != Type::utf8) return "";
+		return {(const char *)data, childCount};
+	}
+
+	// Changing the value of any node (including a container, which drops its children)
+	void setInt(int64_t v) {
+		reset(v < 0 ? Type::integerN : Type::integerP);
+		integer = (v < 0) ? uint64_t(-1 - v) : uint64_t(v);
+	}
+	void setUInt(uint64_t v) {
+		reset(Type::integerP);
+		integer = v;
+	}
+	void setFloat(float v) {
+		reset(Type::float32);
+		float32 = v;
+	}
+	void setFloat(double v) {
+		reset(Type::float64);
+		float64 = v;
+	}
+	void setBool(bool v) {
+		setSimple(20 + v);
+	}
+	void setNull() {
+		setSimple(22);
+	}
+	void setUndefined() {
+		setSimple(23);
+	}
+	void setSimple(unsigned char v) {
+		reset(Type::simple);
+		integer = v;
+	}
+	// These don't copy - use `CborDocument::newUtf8()`/`.newBytes()` for strings which don't outlive the document
+	void setUtf8(const char *ptr, size_t length) {
+		reset(Type::utf8);
+		data = (const unsigned char *)ptr;
+		childCount = length;
+	}
+	void setBytes(const unsigned char *ptr, size_t length) {
+		reset(Type::bytes);
+		data = ptr;
+		childCount = length;
+	}
+
+	// First child (the first key for a map, or the tagged item for a tag), and the node after this one in its parent
+	CborNode * first() const {
+		return firstChild;
+	}
+	CborNode * next() const {
+		return nextSibling;
+	}
+	// Item in an array (linear in the index)
+	template<typename Int>
+	typename std::enable_if<std::is_integral<Int>::value, CborNode *>::type operator[](Int index) const {
+		if (type != Type::array) return nullptr;
+		CborNode *item = firstChild;
+		for (Int i = 0; item && i < index; ++i) item = item->nextSibling;
+		return item;
+	}
+	// Value for a UTF-8 or integer key, or `nullptr`
+	CborNode * find(const char *key, size_t keyLength) const {
+		return findKey([&](const CborNode *k){
+			return k->type == Type::utf8 && k->childCount == keyLength && !std::memcmp(k->data, key, keyLength);
+		});
+	}
+	CborNode * find(const char *key) const {
+		return find(key, std::strlen(key));
+	}
+	CborNode * find(const std::string &key) const {
+		return find(key.data(), key.size());
+	}
+	template<typename Int>
+	typename std::enable_if<std::is_integral<Int>::value, CborNode *>::type find(Int key) const {
+		bool negative = (key < 0);
+		uint64_t magnitude = negative ? (uint64_t)(-1 - (int64_t)key) : (uint64_t)key;
+		return findKey([&](const CborNode *k){
+			return k->type == (negative ? Type::integerN : Type::integerP) && k->integer == magnitude;
+		});
+	}
+	CborNode * operator[](const char *key) const {
+		return find(key);
+	}
+	CborNode * operator[](const std::string &key) const {
+		return find(key);
+	}
+
+	// Adds an item to the end of an array (or sets the item for a tag)
+	void append(CborNode *item) {
+		if (type == Type::tag) {
+			firstChild = lastChild = nullptr;
+			childCount = 0;
+		}
+		link(item);
+	}
+	// Adds a map entry to the end (without checking for an existing key)
+	void add(CborNode *key, CborNode *value) {
+		link(key);
+		link(value);
+	}
+	// Removes an array item, or a map entry (given its key).  Returns false if it's not a child of this node.
+	bool remove(CborNode *child) {
+		CborNode *previous = nullptr;
+		for (CborNode *item = firstChild; item; item = item->nextSibling) {
+			if (item == child) {
+				CborNode *after = (type == Type::map && item->nextSibling) ? item->nextSibling->nextSibling : item->nextSibling;
+				CborNode *removedLast = (type == Type::map && item->nextSibling) ? item->nextSibling : item;
+				removedLast->nextSibling = nullptr;
+				if (previous) {
+					previous->nextSibling = after;
+				} else {
+					firstChild = after;
+				}
+				if (!after) lastChild = previous;
+				childCount -= (type == Type::map) ? 2 : 1;
+				return true;
+			}
+			previous = item;
+			if (type == Type::map) {
+				previous = item->nextSibling;
+				if (!previous) break;
+				item = previous;
+			}
+		}
+		return false;
+	}
+
+private:
+	friend struct CborDocument;
+
+	Type type;
+	size_t childCount; // or the length, for strings
+	union {
+		uint64_t integer; // magnitude for negative ints (value = -1 - integer), tag number, or simple value
+		float float32;
+		double float64;
+		const unsigned char *data;
+	};
+	CborNode *firstChild, *lastChild, *nextSibling;
+
+	void reset(Type newType) {
+		type = newType;
+		childCount = 0;
+		firstChild = lastChild = nullptr;
+	}
+	void link(CborNode *item) {
+		item->nextSibling = nullptr;
+		if (lastChild) {
+			lastChild->nextSibling = item;
+		} else {
+			firstChild = item;
+		}
+		lastChild = item;
+		++childCount;
+	}
+	template<class Match>
+	CborNode * findKey(Match &&match) const {
+		if (type != Type::map) return nullptr;
+		for (CborNode *key = firstChild; key && key->nextSibling; key = key->nextSibling->nextSibling) {
+			if (match(key)) return key->nextSibling;
+		}
+		return nullptr;
+	}
+};
+
+// Mutable tree built from a `CborWalker` in a single pass, with nodes allocated from an arena (so there's one allocation per block of nodes, and no per-node frees)
+// Definite-length strings point into the source buffer, so it has to outlive the document.  Nodes are only released by `.clear()` or destruction.
+struct CborDocument {
+	CborDocument(size_t blockNodes=4096, size_t blockBytes=65536) : blockNodes(blockNodes < 16 ? 16 : blockNodes), blockBytes(blockBytes < 256 ? 256 : blockBytes) {}
+	CborDocument(const CborDocument &other) = delete;
+
+	// Replaces the root with a tree for one item, returning `nullptr` if there was an error
+	CborNode * parse(const CborWalker &cbor) {
+		errorCode = 0;
+		CborWalker item = cbor;
+		rootNode = parseItem(item, 0);
+		return rootNode;
+	}
+	uint64_t error() const {
+		return errorCode;
+	}
+	CborNode * root() const {
+		return rootNode;
+	}
+	void setRoot(CborNode *node) {
+		rootNode = node;
+	}
+
+	// Writes the whole document, or a single node
+	template<class Writer>
+	void write(Writer &writer) const {
+		if (rootNode) write(writer, rootNode);
+	}
+	template<class Writer>
+	static void write(Writer &writer, const CborNode *node) {
+		using Type = CborNode::Type;
+		switch (node->type) {
+		case Type::integerP:
+			writer.addUInt(node->integer);
+			break;
+		case Type::integerN:
+			writer.addNegative(node->integer);
+			break;
+		case Type::bytes:
+			writer.addBytes(node->data, node->childCount);
+			break;
+		case Type::utf8:
+			writer.addUtf8((const char *)node->data, node->childCount);
+			break;
+		case Type::array:
+			writer.openArray(node->childCount);
+			for (const CborNode *item = node->firstChild; item; item = item->nextSibling) write(writer, item);
+			break;
+		case Type::map:
+			writer.openMap(node->childCount/2);
+			for (const CborNode *item = node->firstChild; item; item = item->nextSibling) write(writer, item);
+			break;
+		case Type::tag:
+			writer.addTag(node->integer);
+			if (node->firstChild) {
+				write(writer, node->firstChild);
+			} else {
+				writer.addNull();
+			}
+			break;
+		case Type::simple:
+			writer.addSimple((unsigned char)node->integer);
+			break;
+		case Type::float32:
+			writer.addFloat(node->float32);
+			break;
+		case Type::float64:
+			writer.addFloat(node->float64);
+			break;
+		}
+	}
+
+	// New (unattached) nodes
+	CborNode * newInt(int64_t v) {
+		CborNode *node = newNode(CborNode::Type::integerP);
+		node->setInt(v);
+		return node;
+	}
+	CborNode * newUInt(uint64_t v) {
+		CborNode *node = newNode(CborNode::Type::integerP);
+		node->integer = v;
+		return node;
+	}
+	CborNode * newFloat(double v) {
+		CborNode *node = newNode(CborNode::Type::float64);
+		node->float64 = v;
+		return node;
+	}
+	CborNode * newBool(bool v) {
+		CborNode *node = newNode(CborNode::Type::simple);
+		node->integer = 20 + v;
+		return node;
+	}
+	CborNode * newNull() {
+		CborNode *node = newNode(CborNode::Type::simple);
+		node->integer = 22;
+		return node;
+	}
+	// Strings are copied into the document
+	CborNode * newUtf8(const char *ptr, size_t length) {
+		CborNode *node = newNode(CborNode::Type::utf8);
+		node->data = copyBytes((const unsigned char *)ptr, length);
+		node->childCount = length;
+		return node;
+	}
+	CborNode * newUtf8(const char *str) {
+		return newUtf8(str, std::strlen(str));
+	}
+	CborNode * newUtf8(const std::string &str) {
+		return newUtf8(str.data(), str.size());
+	}
+	CborNode * newBytes(const unsigned char *ptr, size_t length) {
+		CborNode *node = newNode(CborNode::Type::bytes);
+		node->data = copyBytes(ptr, length);
+		node->childCount = length;
+		return node;
+	}
+	CborNode * newArray() {
+		return newNode(CborNode::Type::array);
+	}
+	CborNode * newMap() {
+		return newNode(CborNode::Type::map);
+	}
+	CborNode * newTag(uint64_t tag, CborNode *item) {
+		CborNode *node = newNode(CborNode::Type::tag);
+		node->integer = tag;
+		node->link(item);
+		return node;
+	}
+
+	// Forgets all nodes (and copied strings), but keeps the memory for re-use
+	void clear() {
+		for (auto &block : nodeBlocks) block.clear();
+		for (auto &block : byteBlocks) block.clear();
+		nodeBlock = byteBlock = 0;
+		rootNode = nullptr;
+		errorCode = 0;
+	}
+	// Memory held by the arena
+	size_t capacityBytes() const {
+		size_t total = 0;
+		for (auto &block : nodeBlocks) total += block.capacity()*sizeof(CborNode);
+		for (auto &block : byteBlocks) total += block.capacity();
+		return total;
+	}
+
+private:
+	size_t blockNodes, blockBytes;
+	// Blocks never grow past their reserved capacity, so node pointers stay valid
+	std::vector<std::vector<CborNode>> nodeBlocks;
+	std::vector<std::vector<unsigned char>> byteBlocks;
+	size_t nodeBlock = 0, byteBlock = 0;
+	CborNode *rootNode = nullptr;
+	uint64_t errorCode = 0;
+
+	CborNode * newNode(CborNode::Type type) {
+		if (nodeBlock < nodeBlocks.size() && nodeBlocks[nodeBlock].size() == nodeBlocks[nodeBlock].capacity()) ++nodeBlock;
+		if (nodeBlock == nodeBlocks.size()) {
+			nodeBlocks.emplace_back();
+			nodeBlocks.back().reserve(blockNodes);
+		}
+		std::vector<CborNode> &block = nodeBlocks[nodeBlock];
+		block.emplace_back(type);
+		return &block.back();
+	}
+	unsigned char * allocateBytes(size_t length) {
+		while (byteBlock < byteBlocks.size() && byteBlocks[byteBlock].capacity() - byteBlocks[byteBlock].size() < length) ++byteBlock;
+		if (byteBlock == byteBlocks.size()) {
+			byteBlocks.emplace_back();
+			byteBlocks.back().reserve(std::max(blockBytes, length));
+		}
+		std::vector<unsigned char> &block = byteBlocks[byteBlock];
+		size_t offset = block.size();
+		block.resize(offset + length);
+		return block.data() + offset;
+	}
+	const unsigned char * copyBytes(const unsigned char *ptr, size_t length) {
+		unsigned char *copy = allocateBytes(length);
+		if (length) std::memcpy(copy, ptr, length);
+		return copy;
+	}
+
+	CborNode * fail(uint64_t code) {
+		if (!errorCode) errorCode = code;
+		return nullptr;
+	}
+
+	// Single pass: builds a node for the item and moves past it, or returns `nullptr` and sets `errorCode`
+	CborNode * parseItem(CborWalker &item, size_t depth) {
+		using TypeCode = CborWalker::TypeCode;
+		using Type = CborNode::Type;
+		if (depth > CBOR_WALKER_MAX_DEPTH) return fail(CborWalker::ERROR_TOO_DEEP);
+		CborNode *node = nullptr;
+		switch (item.typeCode) {
+		case TypeCode::integerP:
+		case TypeCode::integerN:
+		case TypeCode::simple:
+			node = newNode(item.typeCode == TypeCode::integerP ? Type::integerP : item.typeCode == TypeCode::integerN ? Type::integerN : Type::simple);
+			node->integer = item.additional;
+			item = item.nextBasic();
+			return node;
+		case TypeCode::float32:
+			node = newNode(Type::float32);
+			node->float32 = item.float32;
+			item = item.nextBasic();
+			return node;
+		case TypeCode::float64:
+			node = newNode(Type::float64);
+			node->float64 = item.float64;
+			item = item.nextBasic();
+			return node;
+		case TypeCode::bytes:
+		case TypeCode::utf8:
+			node = newNode(item.typeCode == TypeCode::bytes ? Type::bytes : Type::utf8);
+			node->data = item.dataNext;
+			node->childCount = item.length();
+			item = item.next();
+			return node;
+		case TypeCode::indefiniteBytes:
+		case TypeCode::indefiniteUtf8: {
+			// Chunks are joined into the byte arena
+			size_t total = 0;
+			CborWalker end = item.forEach([&](const CborWalker &chunk, size_t){
+				total += chunk.length();
+			});
+			if (end.error() && !end.atEnd()) return fail(end.error());
+			unsigned char *joined = allocateBytes(total);
+			node = newNode(item.typeCode == TypeCode::indefiniteBytes ? Type::bytes : Type::utf8);
+			node->data = joined;
+			node->childCount = total;
+			item.forEach([&](const CborWalker &chunk, size_t){
+				if (chunk.length()) std::memcpy(joined, chunk.dataNext, chunk.length());
+				joined += chunk.length();
+			});
+			item = end;
+			return node;
+		}
+		case TypeCode::array:
+		case TypeCode::map:
+		case TypeCode::indefiniteArray:
+		case TypeCode::indefiniteMap: {
+			bool isMap = (item.typeCode == TypeCode::map || item.typeCode == TypeCode::indefiniteMap);
+			bool definite = item.hasLength();
+			uint64_t remaining = definite ? item.additional*(isMap ? 2 : 1) : 0;
+			node = newNode(isMap ? Type::map : Type::array);
+			CborWalker child = item.enter();
+			while (definite ? remaining > 0 : !child.isExit()) {
+				if (child.error()) return fail(child.error());
+				CborNode *childNode = parseItem(child, depth + 1);
+				if (!childNode) return nullptr;
+				node->link(childNode);
+				--remaining;
+			}
+			if (isMap && (node->childCount&1)) return fail(CborWalker::ERROR_INVALID_VALUE);
+			item = definite ? child : child.nextBasic();
+			return node;
+		}
+		case TypeCode::tag: {
+			node = newNode(Type::tag);
+			node->integer = item.additional;
+			CborWalker inner = item.enter();
+			if (inner.error()) return fail(inner.error());
+			CborNode *childNode = parseItem(inner, depth + 1);
+			if (!childNode) return nullptr;
+			node->link(childNode);
+			item = inner;
+			return node;
+		}
+		case TypeCode::indefiniteBreak:
+			return fail(CborWalker::ERROR_INVALID_VALUE);
+		case TypeCode::error:
+		default:
+			return fail(item.error() ? item.error() : CborWalker::ERROR_SHOULD_BE_IMPOSSIBLE);
+		}
 	}
 };
 
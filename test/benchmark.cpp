@@ -0,0 +1,631 @@
+#define CBOR_WALKER_MAPPED_FILE
+#include "../cbor-walker.h"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <thread>
+
+#ifdef CBOR_WALKER_UNCHECKED
+static const char *variant = "unchecked";
+#else
+static const char *variant = "checked";
+#endif
+
+// Runs the function repeatedly (for at least a fixed time), and prints the time per unit of work
+template<class Fn>
+void benchmark(const std::string &name, size_t unitsPerRun, const char *unitName, Fn &&fn) {
+	using Clock = std::chrono::steady_clock;
+	size_t runs = 0;
+	auto start = Clock::now();
+	double seconds = 0;
+	while (seconds < 0.5) {
+		fn();
+		++runs;
+		seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	}
+	double nsPerUnit = seconds*1e9/(runs*unitsPerRun);
+	std::cout << std::left << std::setw(40) << (name + " (" + variant + ")") << std::right << std::fixed << std::setprecision(3) << std::setw(10) << nsPerUnit << " ns/" << unitName << "\n";
+}
+
+// Writes every byte separately with `push_back()`, for comparison
+struct CborWriterPerByte : public signalsmith::cbor::CborWriterBase<CborWriterPerByte> {
+	CborWriterPerByte(std::vector<unsigned char> &bytes) : bytes(bytes) {}
+	
+	std::vector<unsigned char> &bytes;
+	void writeByte(unsigned char b) {
+		bytes.push_back(b);
+	}
+	void writeBytes(const unsigned char *ptr, size_t length) {
+		for (size_t i = 0; i < length; ++i) bytes.push_back(ptr[i]);
+	}
+};
+
+template<class Writer>
+void writeRecords(Writer &writer, size_t count) {
+	writer.openArray(count);
+	for (size_t i = 0; i < count; ++i) {
+		writer.openMap(4);
+		writer.addUtf8("id");
+		writer.addUInt(i*7919);
+		writer.addUtf8("name");
+		writer.addUtf8("item");
+		writer.addUtf8("value");
+		writer.addFloat(i*0.5);
+		writer.addUtf8("flags");
+		writer.openArray(3);
+		writer.addInt(-(int64_t)i*1000);
+		writer.addInt(i%24);
+		writer.addBool(i%2);
+	}
+}
+
+// Sums integers and string lengths, without creating any walkers
+struct SumVisitor : public signalsmith::cbor::CborVisitor {
+	uint64_t total = 0;
+	void onInt(int64_t v) {
+		total += v;
+	}
+	void onUtf8(const char *, size_t length) {
+		total += length;
+	}
+};
+
+// Matches the records in the benchmark document (ignoring "flags")
+struct BoundRecord {
+	uint64_t id = 0;
+	std::string name;
+	double value = 0;
+
+	template<class Fields>
+	void cborFields(Fields &fields) {
+		fields("id", id);
+		fields("name", name);
+		fields("value", value);
+	}
+};
+
+// The same fields, with integer keys
+struct BoundPackedRecord {
+	uint64_t id = 0;
+	std::string name;
+	double value = 0;
+
+	template<class Fields>
+	void cborFields(Fields &fields) {
+		fields(0, id);
+		fields(1, name);
+		fields(2, value);
+	}
+};
+
+// Tree with one allocation per node (and per string), for comparison with `CborDocument`
+struct NaiveNode {
+	enum {number, string, array, map, other} type = other;
+	double value = 0;
+	std::string text;
+	std::vector<NaiveNode> items;
+	std::map<std::string, NaiveNode> entries;
+
+	static NaiveNode build(const signalsmith::cbor::CborWalker &cbor) {
+		NaiveNode node;
+		if (cbor.isNumber()) {
+			node.type = number;
+			node.value = cbor;
+		} else if (cbor.isUtf8()) {
+			node.type = string;
+			node.text = cbor.utf8();
+		} else if (cbor.isArray()) {
+			node.type = array;
+			cbor.forEach([&](const signalsmith::cbor::CborWalker &item, size_t){
+				node.items.push_back(build(item));
+			});
+		} else if (cbor.isMap()) {
+			node.type = map;
+			cbor.forEachPair([&](const signalsmith::cbor::CborWalker &key, const signalsmith::cbor::CborWalker &value){
+				node.entries[key.utf8()] = build(value);
+			});
+		}
+		return node;
+	}
+};
+
+// Stops the compiler optimising away results
+static volatile uint64_t sink;
+
+template<class T>
+void benchmarkTypedArray(const char *typeName) {
+	constexpr size_t length = 1000000;
+	std::vector<T> values(length), output(length);
+	for (size_t i = 0; i < length; ++i) values[i] = T(i*0.75);
+	for (bool bigEndian : {false, true}) {
+		std::string name = std::string(typeName) + (bigEndian ? " BE" : " LE");
+		std::vector<unsigned char> bytes;
+		bytes.reserve(length*sizeof(T) + 16);
+		benchmark("addTypedArray(): " + name, length, "element", [&](){
+			bytes.clear();
+			signalsmith::cbor::CborWriter writer(bytes);
+			writer.addTypedArray(values.data(), length, bigEndian);
+			sink = bytes.size();
+		});
+		signalsmith::cbor::TaggedCborWalker cbor(bytes.data(), bytes.data() + bytes.size());
+		benchmark("readTypedArray(): " + name, length, "element", [&](){
+			sink = cbor.readTypedArray(output);
+		});
+	}
+}
+
+void benchmarkFloat16() {
+	constexpr size_t length = 1000000;
+	std::vector<float> values(length), output(length);
+	for (size_t i = 0; i < length; ++i) values[i] = float(i%4096)*0.125f - 256;
+	for (bool bigEndian : {false, true}) {
+		std::string name = std::string("float16") + (bigEndian ? " BE" : " LE");
+		std::vector<unsigned char> bytes;
+		bytes.reserve(length*2 + 16);
+		benchmark("addTypedArrayFloat16(): " + name, length, "element", [&](){
+			bytes.clear();
+			signalsmith::cbor::CborWriter writer(bytes);
+			writer.addTypedArrayFloat16(values.data(), length, bigEndian);
+			sink = bytes.size();
+		});
+		signalsmith::cbor::TaggedCborWalker cbor(bytes.data(), bytes.data() + bytes.size());
+		benchmark("readTypedArray(): " + name, length, "element", [&](){
+			sink = cbor.readTypedArray(output);
+		});
+	}
+}
+
+int main() {
+	using signalsmith::cbor::CborWalker;
+	using signalsmith::cbor::CborWriter;
+
+	std::vector<unsigned char> document;
+	size_t itemCount = 0;
+	{
+		CborWriter writer(document);
+		writer.openArray(100000);
+		for (size_t i = 0; i < 100000; ++i) {
+			writer.openMap(4);
+			writer.addUtf8("id");
+			writer.addUInt(i*7919);
+			writer.addUtf8("name");
+			writer.addUtf8("item-" + std::to_string(i));
+			writer.addUtf8("value");
+			writer.addFloat(i*0.5);
+			writer.addUtf8("flags");
+			writer.openArray(3);
+			writer.addInt(-(int64_t)i);
+			writer.addInt(i%24);
+			writer.addBool(i%2);
+		}
+		itemCount = 1 + 100000*(1 + 8 + 3);
+	}
+
+	benchmarkTypedArray<uint16_t>("uint16");
+	benchmarkTypedArray<int16_t>("int16");
+	benchmarkTypedArray<uint32_t>("uint32");
+	benchmarkTypedArray<int32_t>("int32");
+	benchmarkTypedArray<uint64_t>("uint64");
+	benchmarkTypedArray<int64_t>("int64");
+	benchmarkTypedArray<float>("float32");
+	benchmarkTypedArray<double>("float64");
+	benchmarkFloat16();
+
+	constexpr size_t writeCount = 10000;
+	benchmark("write: per-byte push_back()", writeCount, "record", [&](){
+		std::vector<unsigned char> bytes;
+		CborWriterPerByte writer(bytes);
+		writeRecords(writer, writeCount);
+		sink = bytes.size();
+	});
+	benchmark("write: CborWriter", writeCount, "record", [&](){
+		std::vector<unsigned char> bytes;
+		CborWriter writer(bytes);
+		writeRecords(writer, writeCount);
+		sink = bytes.size();
+	});
+	benchmark("write: CborWriter (reserved)", writeCount, "record", [&](){
+		std::vector<unsigned char> bytes;
+		CborWriter writer(bytes, writeCount*64);
+		writeRecords(writer, writeCount);
+		sink = bytes.size();
+	});
+	{
+		std::vector<unsigned char> deterministicBytes;
+		benchmark("write: CborWriter (deterministic)", writeCount, "record", [&](){
+			deterministicBytes.clear();
+			CborWriter writer(deterministicBytes);
+			writer.deterministic = true;
+			writeRecords(writer, writeCount);
+			sink = deterministicBytes.size();
+		});
+		benchmark("isCanonical()", deterministicBytes.size(), "byte", [&](){
+			sink = signalsmith::cbor::isCanonical(deterministicBytes);
+		});
+		benchmark("validate() (same data)", deterministicBytes.size(), "byte", [&](){
+			sink = signalsmith::cbor::validate(deterministicBytes).items;
+		});
+	}
+	benchmark("write: CborWriterChunked", writeCount, "record", [&](){
+		signalsmith::cbor::CborWriterChunked writer;
+		writeRecords(writer, writeCount);
+		sink = writer.size();
+	});
+	{
+		std::vector<unsigned char> fixedBuffer(writeCount*64);
+		benchmark("write: CborWriterFixed", writeCount, "record", [&](){
+			signalsmith::cbor::CborWriterFixed writer(fixedBuffer.data(), fixedBuffer.size());
+			writeRecords(writer, writeCount);
+			sink = writer.size();
+		});
+	}
+	benchmark("write: CborWriterStream", writeCount, "record", [&](){
+		std::ostringstream stream;
+		signalsmith::cbor::CborWriterStream writer(stream);
+		writeRecords(writer, writeCount);
+		sink = stream.tellp();
+	});
+	benchmark("write: CborWriterBufferedStream", writeCount, "record", [&](){
+		std::ostringstream stream;
+		{
+			signalsmith::cbor::CborWriterBufferedStream writer(stream);
+			writeRecords(writer, writeCount);
+		}
+		sink = stream.tellp();
+	});
+	{
+		// Unknown element counts: indefinite-length vs. patched definite-length arrays
+		std::vector<unsigned char> indefiniteBytes, patchedBytes;
+		benchmark("write: indefinite arrays", writeCount, "array", [&](){
+			indefiniteBytes.clear();
+			CborWriter writer(indefiniteBytes);
+			for (size_t i = 0; i < writeCount; ++i) {
+				writer.openArray();
+				for (size_t j = 0; j < i%50; ++j) writer.addInt(j);
+				writer.close();
+			}
+			sink = indefiniteBytes.size();
+		});
+		benchmark("write: patched arrays", writeCount, "array", [&](){
+			patchedBytes.clear();
+			CborWriter writer(patchedBytes);
+			for (size_t i = 0; i < writeCount; ++i) {
+				auto head = writer.openArrayPatchable();
+				for (size_t j = 0; j < i%50; ++j) writer.addInt(j);
+				writer.close(head, i%50);
+			}
+			sink = patchedBytes.size();
+		});
+		benchmark("next() over indefinite arrays", writeCount, "array", [&](){
+			CborWalker cbor(indefiniteBytes);
+			while (!cbor.error()) ++cbor;
+			sink = cbor.atEnd();
+		});
+		benchmark("next() over patched arrays", writeCount, "array", [&](){
+			CborWalker cbor(patchedBytes);
+			while (!cbor.error()) ++cbor;
+			sink = cbor.atEnd();
+		});
+	}
+	{
+		constexpr size_t floatCount = 100000;
+		std::vector<double> floatValues(floatCount);
+		for (size_t i = 0; i < floatCount; ++i) floatValues[i] = (i%3 == 0) ? i*0.25 : (i%3 == 1) ? float(i*0.001) : i*0.001;
+		for (bool shortest : {false, true}) {
+			std::vector<unsigned char> bytes;
+			bytes.reserve(floatCount*9);
+			benchmark(shortest ? "addFloat() shortest" : "addFloat()", floatCount, "float", [&](){
+				bytes.clear();
+				CborWriter writer(bytes);
+				writer.shortestFloats = shortest;
+				for (double v : floatValues) writer.addFloat(v);
+				sink = bytes.size();
+			});
+			std::cout << "\t" << bytes.size() << " bytes\n";
+		}
+	}
+
+	benchmark("walk every item", itemCount, "item", [&](){
+		CborWalker cbor(document);
+		uint64_t total = 0;
+		while (!cbor.error()) {
+			total += (uint64_t)cbor;
+			cbor = cbor.enter();
+		}
+		sink = total;
+	});
+	benchmark("next() over whole document", document.size(), "byte", [&](){
+		CborWalker cbor(document);
+		sink = cbor.next().atEnd();
+	});
+	benchmark("validate()", document.size(), "byte", [&](){
+		sink = signalsmith::cbor::validate(document).items;
+	});
+	benchmark("visit()", document.size(), "byte", [&](){
+		SumVisitor visitor;
+		signalsmith::cbor::visit(document, visitor);
+		sink = visitor.total;
+	});
+	for (size_t chunkSize : {size_t(1500), size_t(65536)}) {
+		benchmark("CborStreamParser (" + std::to_string(chunkSize) + "-byte chunks)", document.size(), "byte", [&](){
+			signalsmith::cbor::CborStreamParser parser;
+			uint64_t total = 0;
+			for (size_t start = 0; start < document.size(); start += chunkSize) {
+				parser.push(document.data() + start, std::min(chunkSize, document.size() - start), [&](const CborWalker &item){
+					total += item.length();
+				});
+			}
+			sink = total;
+		});
+	}
+	{
+		std::vector<unsigned char> smallInts;
+		CborWriter writer(smallInts);
+		writer.openArray(1000000);
+		for (size_t i = 0; i < 1000000; ++i) writer.addInt(i%24);
+		benchmark("validate() small-int array", smallInts.size(), "byte", [&](){
+			sink = signalsmith::cbor::validate(smallInts).items;
+		});
+	}
+	benchmark("forEachPair() by hand", 100000, "record", [&](){
+		CborWalker cbor(document);
+		BoundRecord record;
+		uint64_t total = 0;
+		cbor.forEach([&](const CborWalker &item, size_t){
+			item.forEachPair([&](const CborWalker &key, const CborWalker &value){
+				std::string keyString = key.utf8();
+				if (keyString == "id") {
+					record.id = value;
+				} else if (keyString == "name") {
+					record.name = value.utf8();
+				} else if (keyString == "value") {
+					record.value = value;
+				}
+			});
+			total += record.id + record.name.size();
+		});
+		sink = total;
+	});
+	benchmark("decode() vector of bound structs", 100000, "record", [&](){
+		std::vector<BoundRecord> records;
+		signalsmith::cbor::decode(CborWalker(document), records);
+		uint64_t total = 0;
+		for (auto &record : records) total += record.id + record.name.size();
+		sink = total;
+	});
+	{
+		std::vector<BoundRecord> records(100000);
+		std::vector<BoundPackedRecord> packedRecords(100000);
+		for (size_t i = 0; i < records.size(); ++i) {
+			records[i] = {i*7919, "item-" + std::to_string(i), i*0.5};
+			packedRecords[i] = {i*7919, "item-" + std::to_string(i), i*0.5};
+		}
+		std::vector<unsigned char> textKeyed, intKeyed;
+		CborWriter textWriter(textKeyed), intWriter(intKeyed);
+		signalsmith::cbor::encode(textWriter, records);
+		signalsmith::cbor::encode(intWriter, packedRecords);
+		std::cout << "\ttext keys: " << textKeyed.size() << " bytes, integer keys: " << intKeyed.size() << " bytes\n";
+		benchmark("decode() text keys", records.size(), "record", [&](){
+			signalsmith::cbor::decode(CborWalker(textKeyed), records);
+			sink = records.size();
+		});
+		benchmark("decode() integer keys", records.size(), "record", [&](){
+			signalsmith::cbor::decode(CborWalker(intKeyed), packedRecords);
+			sink = packedRecords.size();
+		});
+
+		std::vector<unsigned char> refKeyed;
+		CborWriter refWriter(refKeyed);
+		refWriter.beginStringRefs();
+		signalsmith::cbor::encode(refWriter, records);
+		refWriter.endStringRefs();
+		std::cout << "\ttext keys with stringrefs: " << refKeyed.size() << " bytes\n";
+		benchmark("encode() text keys", records.size(), "record", [&](){
+			textKeyed.clear();
+			signalsmith::cbor::encode(textWriter, records);
+			sink = textKeyed.size();
+		});
+		benchmark("encode() text keys with stringrefs", records.size(), "record", [&](){
+			refKeyed.clear();
+			refWriter.beginStringRefs();
+			signalsmith::cbor::encode(refWriter, records);
+			refWriter.endStringRefs();
+			sink = refKeyed.size();
+		});
+		signalsmith::cbor::CborStringRefs refs;
+		benchmark("decode() text keys with stringrefs", records.size(), "record", [&](){
+			refs.clear();
+			signalsmith::cbor::decode(CborWalker(refKeyed).withStringRefs(refs), records);
+			sink = records.size();
+		});
+	}
+	{
+		signalsmith::cbor::CborDocument doc;
+		benchmark("CborDocument::parse()", 100000, "record", [&](){
+			doc.clear();
+			sink = doc.parse(CborWalker(document))->size();
+		});
+		benchmark("naive tree (std::vector/std::map)", 100000, "record", [&](){
+			sink = NaiveNode::build(CborWalker(document)).items.size();
+		});
+		std::vector<unsigned char> written;
+		written.reserve(document.size());
+		benchmark("CborDocument::write()", 100000, "record", [&](){
+			written.clear();
+			CborWriter writer(written);
+			doc.write(writer);
+			sink = written.size();
+		});
+		std::cout << "\t" << doc.capacityBytes() << " arena bytes, write-back " << (written == document ? "identical" : "different") << "\n";
+	}
+	{
+		// Changing one field near the end of the document
+		CborWalker target = CborWalker(document).enter().next(99990)["name"];
+		std::vector<unsigned char> replacement, edited;
+		CborWriter replacementWriter(replacement);
+		replacementWriter.addUtf8("a longer replacement name");
+		benchmark("CborSplice: replace one field", document.size(), "byte", [&](){
+			signalsmith::cbor::CborSplice splice(document);
+			splice.replace(target, replacement);
+			splice.apply(edited);
+			sink = edited.size();
+		});
+		benchmark("CborSplice: append to top-level array", document.size(), "byte", [&](){
+			signalsmith::cbor::CborSplice splice(document);
+			splice.append(CborWalker(document), replacement);
+			splice.apply(edited);
+			sink = edited.size();
+		});
+		benchmark("copy (for comparison)", document.size(), "byte", [&](){
+			edited.assign(document.begin(), document.end());
+			sink = edited.size();
+		});
+		signalsmith::cbor::CborDocument doc;
+		benchmark("CborDocument: parse, edit, write", document.size(), "byte", [&](){
+			doc.clear();
+			auto *root = doc.parse(CborWalker(document));
+			(*root)[99990]->find("name")->setUtf8("a longer replacement name", 25);
+			edited.clear();
+			CborWriter writer(edited);
+			doc.write(writer);
+			sink = edited.size();
+		});
+	}
+	{
+		signalsmith::cbor::CborRecords records;
+		benchmark("CborRecords::findArray()", document.size(), "byte", [&](){
+			records.findArray(document);
+			sink = records.size();
+		});
+		auto processRecord = [](const CborWalker &record) {
+			BoundRecord bound;
+			signalsmith::cbor::decode(record, bound);
+			return bound.id + bound.name.size();
+		};
+		benchmark("decode records: sequential forEach()", 100000, "record", [&](){
+			uint64_t total = 0;
+			CborWalker(document).forEach([&](const CborWalker &record, size_t){
+				total += processRecord(record);
+			});
+			sink = total;
+		});
+		size_t cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+		for (size_t threads : {size_t(1), size_t(2), size_t(4), cores}) {
+			std::vector<uint64_t> results(100000);
+			benchmark("decode records: forEachParallel() x" + std::to_string(threads), 100000, "record", [&](){
+				records.findArray(document);
+				records.forEachParallel([&](const CborWalker &record, size_t index){
+					results[index] = processRecord(record);
+				}, threads);
+				sink = results.back();
+			});
+		}
+	}
+	{
+		{
+			std::ofstream file("benchmark-document.cbor", std::ios::binary);
+			file.write((const char *)document.data(), document.size());
+		}
+		benchmark("read file into vector + validate()", document.size(), "byte", [&](){
+			std::ifstream file("benchmark-document.cbor", std::ios::binary);
+			std::vector<unsigned char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+			sink = signalsmith::cbor::validate(bytes).items;
+		});
+		benchmark("CborMappedFile + validate()", document.size(), "byte", [&](){
+			signalsmith::cbor::CborMappedFile mapped("benchmark-document.cbor");
+			sink = signalsmith::cbor::validate(mapped.data(), mapped.size()).items;
+		});
+		benchmark("CborMappedFile: open + first record", 1, "file", [&](){
+			signalsmith::cbor::CborMappedFile mapped("benchmark-document.cbor");
+			sink = (uint64_t)mapped.walker().enter()["id"];
+		});
+	}
+	{
+		// The records as a CBOR Sequence
+		CborWalker first = CborWalker(document).enter();
+		std::vector<unsigned char> sequence(first.itemStart(), (const unsigned char *)document.data() + document.size());
+		signalsmith::cbor::CborSequenceIndex index;
+		benchmark("CborSequenceIndex::build()", sequence.size(), "byte", [&](){
+			index.build(sequence, 16);
+			sink = index.size();
+		});
+		std::vector<unsigned char> stored;
+		CborWriter indexWriter(stored);
+		index.write(indexWriter);
+		std::cout << "\tindex every 16 records: " << stored.size() << " bytes\n";
+		constexpr size_t lookups = 1000;
+		benchmark("record N: next(N)", lookups, "lookup", [&](){
+			uint64_t total = 0;
+			for (size_t i = 0; i < lookups; ++i) total += (uint64_t)CborWalker(sequence).next((i*7919)%100000)["id"];
+			sink = total;
+		});
+		benchmark("record N: CborSequenceIndex", lookups, "lookup", [&](){
+			uint64_t total = 0;
+			for (size_t i = 0; i < lookups; ++i) total += (uint64_t)index.record(sequence, (i*7919)%100000)["id"];
+			sink = total;
+		});
+	}
+	{
+		benchmark("nested forEach() + string compares", 100000, "record", [&](){
+			uint64_t total = 0;
+			CborWalker(document).forEach([&](const CborWalker &record, size_t){
+				record.forEachPair([&](const CborWalker &key, const CborWalker &value){
+					if (key.utf8() == "flags") {
+						value.forEach([&](const CborWalker &flag, size_t i){
+							if (i == 1) total += (uint64_t)flag;
+						});
+					}
+				});
+			});
+			sink = total;
+		});
+		signalsmith::cbor::CborPath path("$[*].flags[1]");
+		benchmark("CborPath $[*].flags[1]", 100000, "record", [&](){
+			uint64_t total = 0;
+			path.forEach(CborWalker(document), [&](const CborWalker &flag){
+				total += (uint64_t)flag;
+			});
+			sink = total;
+		});
+		benchmark("CborPath compile()", 1, "path", [&](){
+			signalsmith::cbor::CborPath compiled("$.events[*].payload['id']");
+			sink = (bool)compiled;
+		});
+	}
+	{
+		// Three fields from each record
+		signalsmith::cbor::CborPath idPath("$.id"), namePath("$.name"), flagPath("$.flags[1]");
+		benchmark("3 fields: CborPath first() each", 100000, "record", [&](){
+			uint64_t total = 0;
+			CborWalker(document).forEach([&](const CborWalker &record, size_t){
+				total += (uint64_t)idPath.first(record) + namePath.first(record).length() + (uint64_t)flagPath.first(record);
+			});
+			sink = total;
+		});
+		signalsmith::cbor::CborProjection projection{"$.id", "$.name", "$.flags[1]"};
+		CborWalker slots[3];
+		benchmark("3 fields: CborProjection", 100000, "record", [&](){
+			uint64_t total = 0;
+			CborWalker(document).forEach([&](const CborWalker &record, size_t){
+				projection.extract(record, slots);
+				total += (uint64_t)slots[0] + slots[1].length() + (uint64_t)slots[2];
+			});
+			sink = total;
+		});
+	}
+	benchmark("forEach() + find()", 100000, "record", [&](){
+		CborWalker cbor(document);
+		uint64_t total = 0;
+		cbor.forEach([&](const CborWalker &record, size_t){
+			total += (uint64_t)record["id"];
+		});
+		sink = total;
+	});
+}
@@ -1,7 +1,7 @@
 #include <iostream>
 #define LOG_EXPR(expr) std::cout << #expr << " = " << (expr) << std::endl;
 
-#define CBOR_WALKER_HALF_PRECISION_FLOAT
+#define CBOR_WALKER_MAPPED_FILE
 #include "../cbor-walker.h"
 
 #include <string>
@@ -54,6 +54,138 @@ void printTypedArray(const char *name, std::ostream &out) {
 	}
 }
 
+// Writes and reads back a typed array, both directly and via a conversion to `double`
+template<class T>
+bool typedArrayRoundTrip(size_t length, bool bigEndian, size_t offset=0) {
+	std::vector<T> values(length);
+	for (size_t i = 0; i < length; ++i) {
+		values[i] = T(std::is_signed<T>::value ? (i*37.5 - 400) : i*37.5);
+	}
+	std::vector<unsigned char> bytes;
+	signalsmith::cbor::CborWriter writer(bytes);
+	if constexpr (sizeof(T) == 1) {
+		writer.addTypedArray(values.data(), length);
+	} else {
+		writer.addTypedArray(values.data(), length, bigEndian);
+	}
+	
+	signalsmith::cbor::TaggedCborWalker cbor(bytes.data(), bytes.data() + bytes.size());
+	if (!cbor.isTypedArray() || cbor.typedArrayLength() != length) return false;
+
+	std::vector<T> direct(length);
+	std::vector<double> converted(length);
+	T *pointer = direct.data();
+	if (cbor.readTypedArray(pointer, offset, length) != length - offset) return false;
+	if (cbor.readTypedArray(converted, offset, length) != length - offset) return false;
+	for (size_t i = 0; i + offset < length; ++i) {
+		if (direct[i] != values[i + offset]) return false;
+		if (converted[i] != (double)values[i + offset]) return false;
+	}
+	return true;
+}
+
+// Records `visit()` events as text
+struct EventLogVisitor : public signalsmith::cbor::CborVisitor {
+	std::string log;
+
+	void onInt(int64_t v) {
+		log += std::to_string(v) + ",";
+	}
+	void onUInt(uint64_t v) {
+		log += "u" + std::to_string(v) + ",";
+	}
+	void onNegative(uint64_t v) {
+		log += "-1-" + std::to_string(v) + ",";
+	}
+	void onFloat(double v) {
+		std::ostringstream stream;
+		stream << v;
+		log += stream.str() + ",";
+	}
+	void onBool(bool b) {
+		log += b ? "true," : "false,";
+	}
+	void onNull() {
+		log += "null,";
+	}
+	void onBytes(const unsigned char *, size_t length) {
+		log += "h" + std::to_string(length) + ",";
+	}
+	void onUtf8(const char *str, size_t length) {
+		log += "\"" + std::string(str, length) + "\",";
+	}
+	void onBeginUtf8() {
+		log += "(";
+	}
+	void onEndUtf8() {
+		log += "),";
+	}
+	void onBeginArray(uint64_t length) {
+		log += (length == indefinite) ? "[_ " : "[" + std::to_string(length) + " ";
+	}
+	void onEndArray() {
+		log += "],";
+	}
+	void onBeginMap(uint64_t pairs) {
+		log += (pairs == indefinite) ? "{_ " : "{" + std::to_string(pairs) + " ";
+	}
+	void onEndMap() {
+		log += "},";
+	}
+	void onTag(uint64_t tag) {
+		log += std::to_string(tag) + ":";
+	}
+};
+
+// Bound structs for `encode()`/`decode()`
+struct BoundPoint {
+	double x = 0, y = 0;
+	
+	template<class Fields>
+	void cborFields(Fields &fields) {
+		fields("x", x);
+		fields("y", y);
+	}
+};
+struct BoundRecord {
+	uint32_t id = 0;
+	int8_t small = 0;
+	bool flag = false;
+	std::string name;
+	BoundPoint origin;
+	std::vector<float> samples;
+	std::vector<std::string> tags;
+	std::vector<BoundPoint> path;
+	
+	template<class Fields>
+	void cborFields(Fields &fields) {
+		fields("id", id);
+		fields("small", small);
+		fields("flag", flag);
+		fields("name", name);
+		fields("origin", origin);
+		fields("samples", samples);
+		fields("tags", tags);
+		fields("path", path);
+	}
+};
+
+// Integer keys, like a COSE key
+struct BoundPackedKey {
+	int kty = 2, alg = -7, crv = 1;
+	std::string kid;
+	double extra = 0;
+
+	template<class Fields>
+	void cborFields(Fields &fields) {
+		fields(1, kty);
+		fields(3, alg);
+		fields(-1, crv);
+		fields(2u, kid);
+		fields("extra", extra);
+	}
+};
+
 template<class Writer>
 void writeExampleDocument(Writer &writer) {
 	writer.addInt(0);
@@ -134,6 +266,14 @@ int main() {
 		cbor = {bytes.data(), bytes.data() + bytes.size()};
 		taggedCbor = {bytes.data(), bytes.data() + bytes.size()};
 	};
+	auto encodeHex = [](const std::vector<unsigned char> &vector){
+		std::string hex;
+		for (auto b : vector) {
+			hex += "0123456789abcdef"[b>>4];
+			hex += "0123456789abcdef"[b&15];
+		}
+		return hex;
+	};
 	auto test = [&](bool condition, const std::string &reason){
 		if (condition) {
 			std::cout << "\t-\t" << reason << std::endl;
@@ -642,6 +782,1116 @@ int main() {
 		test(hadAmt, "had key 2");
 	}
 	
+	{ // Skip index
+		std::vector<unsigned char> nestedBytes;
+		signalsmith::cbor::CborWriter nestedWriter(nestedBytes);
+		nestedWriter.openArray(4);
+		for (size_t a = 0; a < 3; ++a) {
+			nestedWriter.openArray();
+			for (size_t i = 0; i < 1000; ++i) {
+				nestedWriter.openMap(1);
+				nestedWriter.addUtf8("i");
+				nestedWriter.addInt(i);
+			}
+			nestedWriter.close();
+		}
+		nestedWriter.addInt(12345);
+
+		signalsmith::cbor::CborSkipIndex skipIndex;
+		signalsmith::cbor::CborWalker plain(nestedBytes);
+		auto indexed = plain.withSkipIndex(skipIndex);
+		test(indexed.getSkipIndex() == &skipIndex, "index attached");
+		test(skipIndex.size() == 0, "index starts empty");
+		test(indexed.enter().getSkipIndex() == &skipIndex, "index inherited by enter()");
+
+		test((int)indexed.enter().next(3) == 12345, "last item (first pass)");
+		size_t filledSize = skipIndex.size();
+		test(filledSize == 3, "index has entries for the large containers");
+		test((int)indexed.enter().next(3) == 12345, "last item (second pass)");
+		test(skipIndex.size() == filledSize, "index didn't grow");
+		test(indexed.next().atEnd(), "root .next() reaches end");
+		test(skipIndex.size() == filledSize + 1, "index records root");
+		test(plain.enter().next(3).getSkipIndex() == nullptr, "plain walker has no index");
+
+		auto inner = indexed.enter().next().enter().next(500);
+		test(inner.isMap() && (int)inner.enter().next() == 500, "inner item");
+		test((int)inner.nextExit().enter().enter().next() == 0, "nextExit()");
+		test((int)inner.nextExit().enter().enter().next() == 0, "nextExit() (indexed)");
+		test(skipIndex.size() == filledSize + 2, "index records nextExit()");
+
+		signalsmith::cbor::CborSkipIndex fineIndex(0);
+		indexed.withSkipIndex(fineIndex).next();
+		test(fineIndex.size() == 3004, "every container recorded with minBytes = 0");
+		fineIndex.clear();
+		test(fineIndex.size() == 0, "clear()");
+	}
+
+	// Truncated / invalid heads
+	for (const char *hex : {"0x18", "0x1901", "0x1a000f42", "0x1b000000e8d4a510", "0xfb3ff19999999999", "0xf97e", "0x44010203", "0x64494554"}) {
+		decodeHex(hex);
+		test(cbor.error() == signalsmith::cbor::CborWalker::ERROR_END_OF_DATA, "truncated item is ERROR_END_OF_DATA");
+		test(cbor.next().atEnd(), "next() stays at the end");
+	}
+	decodeHex("0x8218");
+	test(cbor.isArray() && cbor.enter().next().atEnd() && cbor.next().atEnd(), "truncated inside array");
+	decodeHex("0x1c");
+	test(cbor.error() == signalsmith::cbor::CborWalker::ERROR_INVALID_ADDITIONAL, "reserved additional info");
+	decodeHex("0x1f");
+	test(cbor.error() == signalsmith::cbor::CborWalker::ERROR_INVALID_ADDITIONAL, "indefinite integer");
+	decodeHex("0x9f01ff");
+	test(cbor.isArray() && cbor.length() == 0, "indefinite length() is 0");
+
+	// Deep nesting doesn't recurse
+	decodeHex("0xd818d81901"); // nested tags
+	test(cbor.next().atEnd(), "skip nested tags");
+	test(taggedCbor.tagCount() == 2 && (int)taggedCbor == 1, "nested tags");
+	decodeHex("0x8201ff");
+	test(cbor.next().error() == signalsmith::cbor::CborWalker::ERROR_INVALID_VALUE, "break inside definite array");
+	decodeHex("0xbf01ff");
+	test(cbor.next().error() == signalsmith::cbor::CborWalker::ERROR_INVALID_VALUE, "odd number of items in indefinite map");
+	decodeHex("0x5f42010261ff");
+	test(cbor.next().error() == signalsmith::cbor::CborWalker::ERROR_INCONSISTENT_INDEFINITE, "inconsistent chunk");
+	{
+		std::vector<unsigned char> deepBytes;
+		for (size_t depth = 0; depth < CBOR_WALKER_MAX_DEPTH; ++depth) {
+			deepBytes.push_back(0x9F); // indefinite array
+		}
+		deepBytes.insert(deepBytes.end(), deepBytes.size(), 0xFF);
+		signalsmith::cbor::CborWalker deep(deepBytes);
+		test(deep.next().atEnd(), "maximum depth");
+		test((bool)signalsmith::cbor::validate(deepBytes), "maximum depth validates");
+		
+		deepBytes.assign(100000, 0x81);
+		deepBytes.push_back(0x00);
+		deep = {deepBytes};
+		test(deep.next().error() == signalsmith::cbor::CborWalker::ERROR_TOO_DEEP, "too deep for next()");
+		test(signalsmith::cbor::validate(deepBytes).error == signalsmith::cbor::CborWalker::ERROR_TOO_DEEP, "too deep for validate()");
+		test(deep.forEach([&](signalsmith::cbor::CborWalker, size_t){}).error() == signalsmith::cbor::CborWalker::ERROR_TOO_DEEP, "too deep for forEach()");
+		test(deep.enter().nextExit().error() == signalsmith::cbor::CborWalker::ERROR_TOO_DEEP, "too deep for nextExit()");
+	}
+
+	// Validation
+	{
+		using signalsmith::cbor::CborWalker;
+		auto validateHex = [&](const char *hex, signalsmith::cbor::CborValidateLimits limits={}) {
+			decodeHex(hex);
+			return signalsmith::cbor::validate(bytes, limits);
+		};
+		test((bool)validateHex("0x8301820203820405"), "valid nested array");
+		test(validateHex("0x8301820203820405").items == 8, "item count");
+		test((bool)validateHex("0x9f018202039f0405ffff"), "valid indefinite array");
+		test((bool)validateHex("0xbf61610161629f0203ffff"), "valid indefinite map");
+		test((bool)validateHex("0x5f42010243030405ff"), "valid indefinite bytes");
+		test((bool)validateHex("0xc074323031332d30332d32315432303a30343a30305a"), "valid tag");
+		test((bool)validateHex("0x98190102030405060708090a0b0c0d0e0f101112131415161718181819"), "valid array of small ints");
+		test(validateHex("0x98190102030405060708090a0b0c0d0e0f101112131415161718181819").items == 26, "item count (small-int runs)");
+		test(validateHex("0x83010203").errorOffset == 0, "no error offset");
+
+		test(validateHex("0x8301820203").error == CborWalker::ERROR_END_OF_DATA, "truncated array");
+		test(validateHex("0x8301820203").errorOffset == 5, "error offset at end");
+		test(validateHex("0x9f0102").error == CborWalker::ERROR_END_OF_DATA, "unterminated indefinite array");
+		test(validateHex("0x0102").error == CborWalker::ERROR_TRAILING_DATA, "trailing data");
+		test((bool)validateHex("0x0102", {256, ~uint64_t(0), true}), "sequence");
+		test(validateHex("0xff").error == CborWalker::ERROR_INVALID_VALUE, "break outside indefinite container");
+		test(validateHex("0xbf01ff").error == CborWalker::ERROR_INVALID_VALUE, "break after indefinite map key");
+		test(validateHex("0x5f4201026161ff").error == CborWalker::ERROR_INCONSISTENT_INDEFINITE, "mixed chunk types");
+		test(validateHex("0x5f4201025f4101ffff").error == CborWalker::ERROR_INCONSISTENT_INDEFINITE, "nested indefinite chunks");
+		test(validateHex("0x1c").error == CborWalker::ERROR_INVALID_ADDITIONAL, "reserved additional info");
+		test(validateHex("0xdf00").error == CborWalker::ERROR_INVALID_ADDITIONAL, "indefinite tag");
+		test(validateHex("0xf810").error == CborWalker::ERROR_INVALID_VALUE, "two-byte simple value < 32");
+		test(validateHex("0x9b00000000ffffffff00").error == CborWalker::ERROR_END_OF_DATA, "huge array length");
+		test(validateHex("0x818181818100", {4}).error == CborWalker::ERROR_TOO_DEEP, "maxDepth");
+		test((bool)validateHex("0x818181818100", {5}), "maxDepth (just enough)");
+		test(validateHex("0x8301820203820405", {256, 7}).error == CborWalker::ERROR_TOO_MANY_ITEMS, "maxItems");
+		test(validateHex("0x98190102030405060708090a0b0c0d0e0f101112131415161718181819", {256, 20}).error == CborWalker::ERROR_TOO_MANY_ITEMS, "maxItems (small-int runs)");
+		test((bool)validateHex("0x62c3bc", {256, ~uint64_t(0), false, true}), "valid UTF-8");
+		test(validateHex("0x62c0af", {256, ~uint64_t(0), false, true}).error == CborWalker::ERROR_INVALID_VALUE, "overlong UTF-8");
+		test(validateHex("0x63eda080", {256, ~uint64_t(0), false, true}).error == CborWalker::ERROR_INVALID_VALUE, "UTF-8 surrogate");
+		test((bool)validateHex("0x62c0af"), "UTF-8 not checked by default");
+	}
+
+	// SAX-style visitor
+	{
+		auto visitHex = [&](const char *hex, signalsmith::cbor::CborValidateLimits limits={}) {
+			decodeHex(hex);
+			EventLogVisitor visitor;
+			if (!signalsmith::cbor::visit(bytes, visitor, limits)) visitor.log += "error";
+			return visitor.log;
+		};
+		test(visitHex("0x8301820203820405") == "[3 1,[2 2,3,],[2 4,5,],],", "visit nested arrays");
+		test(visitHex("0xbf61610161629f0203ffff") == "{_ \"a\",1,\"b\",[_ 2,3,],},", "visit indefinite containers");
+		test(visitHex("0x7f657374726561646d696e67ff") == "(\"strea\",\"ming\",),", "visit indefinite string");
+		test(visitHex("0xa2008001a0") == "{2 0,[0 ],1,{0 },},", "visit empty containers");
+		test(visitHex("0xc11a514b67b0") == "1:1363896240,", "visit tag");
+		test(visitHex("0x9f1bffffffffffffffff3bffffffffffffffff3903e7f4f6f93e00fb3ff199999999999a43010203ff") == "[_ u18446744073709551615,-1-18446744073709551615,-1000,false,null,1.5,1.1,h3,],", "visit scalars");
+		test(visitHex("0x8c000102030405060708091720") == "[12 0,1,2,3,4,5,6,7,8,9,23,-1,],", "visit small-int runs");
+		test(visitHex("0x8301820203") == "[3 1,[2 2,3,],error", "visit stops at error");
+		test(visitHex("0x8201f814") == "[2 1,error", "visit: two-byte simple value < 32");
+		test(visitHex("0x0102", {256, ~uint64_t(0), true}) == "1,2,", "visit sequence");
+	}
+
+	// Struct binding
+	{
+		BoundRecord record;
+		record.id = 4000000000u;
+		record.small = -100;
+		record.flag = true;
+		record.name = std::string("nul\0byte", 8);
+		record.origin = {1.5, -2.5};
+		record.samples = {0.25f, 1e10f, -3};
+		record.tags = {"a", "bc"};
+		record.path = {{1, 2}, {3, 4}};
+		std::vector<unsigned char> recordBytes;
+		signalsmith::cbor::CborWriter recordWriter(recordBytes);
+		signalsmith::cbor::encode(recordWriter, record);
+		
+		signalsmith::cbor::CborWalker recordCbor(recordBytes);
+		test(recordCbor.isMap() && recordCbor.length() == 8, "encode() writes a map");
+		test(signalsmith::cbor::TaggedCborWalker(recordCbor["samples"]).isTypedArrayOf<float>(), "numeric vectors are typed arrays");
+		test((double)recordCbor["origin"]["y"] == -2.5, "nested struct");
+
+		BoundRecord decoded;
+		test(signalsmith::cbor::decode(recordCbor, decoded), "decode()");
+		test(decoded.id == record.id && decoded.small == record.small && decoded.flag && decoded.name == record.name, "decoded scalars");
+		test(decoded.origin.x == 1.5 && decoded.origin.y == -2.5, "decoded nested struct");
+		test(decoded.samples == record.samples && decoded.tags == record.tags, "decoded vectors");
+		test(decoded.path.size() == 2 && decoded.path[1].x == 3 && decoded.path[1].y == 4, "decoded vector of structs");
+
+		recordBytes.clear();
+		signalsmith::cbor::encode(recordWriter, BoundRecord());
+		test(signalsmith::cbor::decode(signalsmith::cbor::CborWalker(recordBytes), decoded) && decoded.samples.empty() && decoded.name.empty(), "empty fields round-trip");
+
+		// Any key order, unknown keys ignored, plain arrays for numeric vectors, missing fields unchanged
+		std::vector<unsigned char> otherBytes;
+		signalsmith::cbor::CborWriter otherWriter(otherBytes);
+		otherWriter.openMap();
+		otherWriter.addUtf8("name");
+		otherWriter.addUtf8("z");
+		otherWriter.addUtf8("unknown");
+		otherWriter.openArray(2);
+		otherWriter.addInt(1);
+		otherWriter.addInt(2);
+		otherWriter.addInt(5);
+		otherWriter.addUtf8("five");
+		otherWriter.addUtf8("samples");
+		otherWriter.openArray();
+		otherWriter.addInt(1);
+		otherWriter.addFloat(2.5);
+		otherWriter.close();
+		otherWriter.addUtf8("id");
+		otherWriter.addTag(1);
+		otherWriter.addInt(7);
+		otherWriter.close();
+		BoundRecord other;
+		other.origin.x = 10;
+		test(signalsmith::cbor::decode(signalsmith::cbor::CborWalker(otherBytes), other), "decode() with unknown keys");
+		test(other.name == "z" && other.id == 7 && other.origin.x == 10, "decoded fields in any order");
+		test(other.samples == std::vector<float>{1, 2.5f}, "decoded numeric vector from plain array");
+
+		otherBytes.clear();
+		otherWriter.openMap(3);
+		otherWriter.addUtf8("id");
+		otherWriter.addInt(-1);
+		otherWriter.addUtf8("small");
+		otherWriter.addInt(200);
+		otherWriter.addUtf8("name");
+		otherWriter.addUtf8("ok");
+		test(!signalsmith::cbor::decode(signalsmith::cbor::CborWalker(otherBytes), other), "decode() type mismatch");
+		test(other.id == 7 && other.small == 0 && other.name == "ok", "mismatched fields are unchanged");
+	}
+
+	// Integer-keyed maps
+	{
+		BoundPackedKey key;
+		key.kid = "k1";
+		key.extra = 0.5;
+		std::vector<unsigned char> keyBytes;
+		signalsmith::cbor::CborWriter keyWriter(keyBytes);
+		signalsmith::cbor::encode(keyWriter, key);
+		std::vector<unsigned char> expectedKey = {0xA5, 0x01, 0x02, 0x03, 0x26, 0x20, 0x01, 0x02, 0x62, 'k', '1', 0x65, 'e', 'x', 't', 'r', 'a', 0xFB, 0x3F, 0xE0, 0, 0, 0, 0, 0, 0};
+		test(keyBytes == expectedKey, "encode() with integer keys");
+		
+		BoundPackedKey decodedKey;
+		decodedKey.alg = 0;
+		decodedKey.crv = 0;
+		test(signalsmith::cbor::decode(signalsmith::cbor::CborWalker(keyBytes), decodedKey), "decode() with integer keys");
+		test(decodedKey.kty == 2 && decodedKey.alg == -7 && decodedKey.crv == 1 && decodedKey.kid == "k1" && decodedKey.extra == 0.5, "decoded integer-keyed fields");
+		
+		signalsmith::cbor::CborMapIndex keyIndex(signalsmith::cbor::CborWalker{keyBytes});
+		test(keyIndex.size() == 5, "index with small integer keys");
+		test((int)keyIndex.find(3) == -7 && (int)keyIndex.find(-1) == 1 && keyIndex.find(2).utf8() == "k1" && (double)keyIndex["extra"] == 0.5, "small integer keys found");
+		test(keyIndex.find(0).error() == signalsmith::cbor::CborWalker::ERROR_NOT_FOUND && keyIndex.find(23).error() == signalsmith::cbor::CborWalker::ERROR_NOT_FOUND, "missing small integer keys");
+
+		decodeHex("0xbf0a010b0217030a05ff"); // indefinite, keys 10/11/23, duplicate 10
+		keyIndex.build(cbor);
+		test(keyIndex.size() == 3 && (int)keyIndex.find(10) == 1 && (int)keyIndex.find(11) == 2 && (int)keyIndex.find(23) == 3, "small keys (first duplicate wins)");
+		decodeHex("0xa3181801181901190100f5");
+		keyIndex.build(cbor);
+		test((int)keyIndex.find(24) == 1 && (int)keyIndex.find(25) == 1 && (bool)keyIndex.find(256), "keys above 23 are hashed");
+	}
+
+	// Stringrefs
+	{
+		using signalsmith::cbor::CborWalker;
+		using signalsmith::cbor::TaggedCborWalker;
+		// Example from http://cbor.schmorp.de/stringref
+		std::vector<std::string> strings = {"1", "222", "333", "4", "555", "666", "777", "888", "999", "aaa", "bbb", "ccc", "ddd", "eee", "fff", "ggg", "hhh", "iii", "jjj", "kkk", "lll", "mmm", "nnn", "ooo", "ppp", "qqq", "rrr", "333", "ssss", "qqq", "rrr", "ssss"};
+		std::vector<unsigned char> refBytes;
+		signalsmith::cbor::CborWriter writer(refBytes);
+		writer.beginStringRefs();
+		writer.openArray(strings.size());
+		for (auto &str : strings) writer.addUtf8(str);
+		writer.endStringRefs();
+		std::vector<unsigned char> expectedTail = {0x63, 'r', 'r', 'r', 0xD8, 0x19, 0x01, 0x64, 's', 's', 's', 's', 0xD8, 0x19, 0x17, 0x63, 'r', 'r', 'r', 0xD8, 0x19, 0x18, 0x18};
+		test(refBytes[0] == 0xD9 && refBytes[1] == 0x01 && refBytes[2] == 0x00 && refBytes.size() == 5 + 2*2 + 24*4 + expectedTail.size(), "stringref namespace length");
+		test(std::equal(expectedTail.begin(), expectedTail.end(), refBytes.end() - expectedTail.size()), "stringref encoding");
+
+		signalsmith::cbor::CborStringRefs refs;
+		TaggedCborWalker array = CborWalker(refBytes).withStringRefs(refs);
+		test(array.isArray() && refs.size() == 1, "namespace scanned lazily");
+		size_t matching = 0;
+		array.forEach([&](const TaggedCborWalker &item, size_t i){
+			matching += (item.utf8() == strings[i] && item.tagCount() == 0);
+		});
+		test(matching == strings.size(), "stringrefs resolved by forEach()");
+		TaggedCborWalker item = array.enter();
+		for (size_t i = 0; i < 27; ++i) ++item;
+		test(item.utf8() == "333" && (item++).utf8() == "333" && item.utf8() == "ssss" && item.next(2).utf8() == "rrr", "stringrefs resolved by ++/next()");
+		test(item.next(4).atEnd(), "end after references");
+		
+		// Repeated map keys
+		std::vector<BoundRecord> records(20);
+		for (size_t i = 0; i < records.size(); ++i) {
+			records[i].id = i;
+			records[i].name = (i%2) ? "odd" : "even";
+			records[i].samples = {float(i), 0.5f};
+			records[i].tags = {"tag", "another tag"};
+			records[i].path.resize(2);
+			records[i].path[1].y = i;
+		}
+		std::vector<unsigned char> plainBytes;
+		signalsmith::cbor::CborWriter plainWriter(plainBytes);
+		signalsmith::cbor::encode(plainWriter, records);
+		refBytes.clear();
+		writer.beginStringRefs();
+		signalsmith::cbor::encode(writer, records);
+		writer.endStringRefs();
+		test(refBytes.size()*10 < plainBytes.size()*9, "stringrefs shrink repeated keys");
+		std::vector<BoundRecord> decoded;
+		test(signalsmith::cbor::decode(CborWalker(refBytes), decoded), "decode() with stringrefs");
+		bool same = decoded.size() == records.size();
+		for (size_t i = 0; same && i < records.size(); ++i) {
+			same = decoded[i].id == i && decoded[i].name == records[i].name && decoded[i].samples == records[i].samples && decoded[i].tags == records[i].tags && decoded[i].path[1].y == i;
+		}
+		test(same, "decoded records match");
+		
+		refs.clear();
+		TaggedCborWalker list = CborWalker(refBytes).withStringRefs(refs);
+		TaggedCborWalker last = list.enter().next(19);
+		test((uint32_t)last["id"] == 19 && last["name"].utf8() == "odd" && (double)last["path"].enter().next()["y"] == 19, "find() with stringref keys");
+		signalsmith::cbor::CborMapIndex index(last);
+		test(index.size() == 8 && index["name"].resolveStringRef().utf8() == "odd", "CborMapIndex with stringref keys");
+		test(CborWalker(refBytes).enter().enter().next().find("name").error() == CborWalker::ERROR_NOT_FOUND, "no table, no resolving");
+		
+		// Indefinite-length strings and nested namespaces
+		refBytes.clear();
+		writer.beginStringRefs();
+		writer.openArray(5);
+		writer.openUtf8();
+		writer.addUtf8("abc");
+		writer.close();
+		writer.addUtf8("abc");
+		writer.beginStringRefs();
+		writer.openArray(1);
+		writer.addUtf8("abc");
+		writer.endStringRefs();
+		writer.addUtf8("abc");
+		writer.addTypedArray((const uint16_t *)nullptr, 0);
+		writer.endStringRefs();
+		std::vector<unsigned char> expectedNested = {0xD9, 0x01, 0x00, 0x85, 0x7F, 0x63, 'a', 'b', 'c', 0xFF, 0x63, 'a', 'b', 'c', 0xD9, 0x01, 0x00, 0x81, 0x63, 'a', 'b', 'c', 0xD8, 0x19, 0x00, 0xD8, 0x45, 0x40};
+		test(refBytes == expectedNested, "indefinite chunks and nested namespaces");
+		refs.clear();
+		TaggedCborWalker nested = TaggedCborWalker(CborWalker(refBytes).withStringRefs(refs)).enter().next(3);
+		test(refs.size() == 2 && nested.utf8() == "abc" && nested.next().isTypedArray(), "resolved after nested namespace");
+		
+		// Positions of a resolved reference are the reference's own
+		decodeHex("d90100839f6568656c6c6f01ff9fd819000203ff07");
+		refs.clear();
+		TaggedCborWalker resolved = TaggedCborWalker(CborWalker(bytes).withStringRefs(refs)).enter().next().enter();
+		test(resolved.utf8() == "hello" && resolved.itemStart() == bytes.data() + 14 && resolved.next().itemStart() == bytes.data() + 17, "resolved stringref position");
+		test(resolved.nextExit().itemStart() == bytes.data() + 20 && (int)resolved.nextExit() == 7, "nextExit() from a resolved stringref");
+		signalsmith::cbor::CborSplice splice(bytes);
+		std::vector<unsigned char> bye = {0x63, 'b', 'y', 'e'};
+		test(splice.replace(resolved, bye) && encodeHex(splice.apply()) == "d90100839f6568656c6c6f01ff9f636279650203ff07", "CborSplice on a resolved stringref");
+	}
+
+	// Deterministic encoding
+	{
+		using signalsmith::cbor::isCanonical;
+		std::vector<unsigned char> sortedBytes;
+		signalsmith::cbor::CborWriter writer(sortedBytes);
+		writer.deterministic = true;
+		writer.openMap(5);
+		writer.addUtf8("b");
+		writer.addInt(1);
+		writer.addUtf8("a");
+		writer.addInt(2);
+		writer.addInt(10);
+		writer.addInt(3);
+		writer.addUtf8("aa");
+		writer.addInt(5);
+		writer.addInt(-1);
+		writer.addInt(4);
+		std::vector<unsigned char> expectedSorted = {0xA5, 0x0A, 0x03, 0x20, 0x04, 0x61, 'a', 0x02, 0x61, 'b', 0x01, 0x62, 'a', 'a', 0x05};
+		test(sortedBytes == expectedSorted, "deterministic map keys sorted");
+		test(isCanonical(sortedBytes), "isCanonical() sorted map");
+		
+		// The same document in a different order, using indefinite lengths
+		auto writeDocument = [&](std::vector<unsigned char> &bytes, bool deterministic, bool reversed){
+			signalsmith::cbor::CborWriter w(bytes);
+			w.deterministic = deterministic;
+			w.addTag(1);
+			auto head = w.openMapPatchable();
+			for (int pass = 0; pass < 2; ++pass) {
+				if (pass == reversed) {
+					w.addUtf8("list");
+					w.openArray();
+					w.addFloat(1.5);
+					w.openMap();
+					if (!reversed) {
+						w.addUtf8("x");
+						w.addUtf8("text");
+					}
+					w.addUtf8("y");
+					w.openBytes();
+					w.addBytes("\x01\x02", 2);
+					w.addBytes("\x03", 1);
+					w.close();
+					if (reversed) {
+						w.addUtf8("x");
+						w.addUtf8("text");
+					}
+					w.close();
+					w.addTypedArray((const uint16_t *)nullptr, 0);
+					w.close();
+				} else if (reversed) {
+					w.addInt(-5);
+					w.addNull();
+					w.addInt(1000);
+					w.addUtf8("abc");
+				} else {
+					w.addInt(1000);
+					w.openUtf8();
+					w.addUtf8("ab");
+					w.addUtf8("c");
+					w.close();
+					w.addInt(-5);
+					w.addNull();
+				}
+			}
+			w.close(head, 3);
+		};
+		std::vector<unsigned char> forwards, backwards, plain;
+		writeDocument(forwards, true, false);
+		writeDocument(backwards, true, true);
+		writeDocument(plain, false, false);
+		test(forwards == backwards, "deterministic output doesn't depend on order");
+		test(isCanonical(forwards) && !isCanonical(plain), "isCanonical() deterministic vs. plain");
+		test(signalsmith::cbor::validate(forwards) && signalsmith::cbor::validate(plain), "both valid");
+		signalsmith::cbor::TaggedCborWalker root(signalsmith::cbor::CborWalker{forwards});
+		test(root.tagCount() == 1 && root.isMap() && root.hasLength() && root.length() == 3, "patchable map is definite");
+		test(root["list"].isArray() && root["list"].hasLength() && (double)root["list"].enter() == 1.5, "indefinite array made definite");
+		test(root["list"].enter().next()["y"].isBytes() && root["list"].enter().next()["y"].hasLength() && root["list"].enter().next()["y"].length() == 3, "indefinite bytes joined");
+		
+		// Bound structs are written with sorted keys
+		BoundRecord record;
+		record.name = "record";
+		record.samples = {1.5f, 2.25f};
+		record.path.resize(2);
+		std::vector<unsigned char> recordBytes;
+		signalsmith::cbor::CborWriter recordWriter(recordBytes);
+		recordWriter.deterministic = true;
+		signalsmith::cbor::encode(recordWriter, record);
+		test(isCanonical(recordBytes), "deterministic encode()");
+		BoundRecord decodedRecord;
+		test(signalsmith::cbor::decode(signalsmith::cbor::CborWalker(recordBytes), decodedRecord) && decodedRecord.name == "record" && decodedRecord.samples == record.samples && decodedRecord.path.size() == 2, "deterministic encode() round-trip");
+		
+		// Stringref indices would follow write order, which sorting changes, so they're disabled
+		std::vector<unsigned char> refBytes;
+		signalsmith::cbor::CborWriter refWriter(refBytes);
+		refWriter.deterministic = true;
+		refWriter.beginStringRefs();
+		refWriter.openArray(2);
+		for (int i = 0; i < 2; ++i) {
+			refWriter.openMap(2);
+			refWriter.addUtf8("zzzz");
+			refWriter.addInt(1 + 2*i);
+			refWriter.addUtf8("aaaa");
+			refWriter.addInt(2 + 2*i);
+		}
+		refWriter.endStringRefs();
+		test(encodeHex(refBytes) == "82a2646161616102647a7a7a7a01a2646161616104647a7a7a7a03", "deterministic writing ignores stringrefs");
+		test(isCanonical(refBytes) && (int)signalsmith::cbor::CborWalker(refBytes).enter().next()["zzzz"] == 3, "deterministic stringref output decodes");
+		
+		const char *canonical[] = {"17", "1818", "190100", "3818", "f93e00", "fa3f8ccccd", "fb3ff199999999999a", "f97e00", "f820", "a2616101616202", "a20a012001", "c11a5f000000", "80", "a0", "40"};
+		for (auto hex : canonical) {
+			decodeHex(hex);
+			test(isCanonical(bytes), "canonical");
+		}
+		const char *notCanonical[] = {"1817", "3817", "190001", "1a0000ffff", "fa3fc00000", "fb3ff8000000000000", "f817", "9f01ff", "5f4101ff", "a2616201616102", "a2616101616102", "0102", "c11a00000001", "8201", "", "a1616101a0"};
+		for (auto hex : notCanonical) {
+			decodeHex(hex);
+			test(!isCanonical(bytes), "not canonical");
+		}
+	}
+
+	// Mutable DOM
+	{
+		using signalsmith::cbor::CborWalker;
+		signalsmith::cbor::CborDocument doc(16, 256); // small blocks, to test spilling into new ones
+		auto writeHex = [&](const signalsmith::cbor::CborNode *node) {
+			std::vector<unsigned char> out;
+			signalsmith::cbor::CborWriter writer(out);
+			doc.write(writer, node);
+			return encodeHex(out);
+		};
+		
+		const char *roundTrip[] = {"00", "3903e7", "fa3fc00000", "fb3ff199999999999a", "f6", "f820", "6449455446", "43010203", "c11a514b67b0", "83010203", "a2616101616282f5f4", "8a000102030405060708a1616180", "a20a012001", "3bffffffffffffffff"};
+		for (auto hex : roundTrip) {
+			decodeHex(hex);
+			auto *root = doc.parse(CborWalker(bytes));
+			test(root && !doc.error(), "parse");
+			test(writeHex(root) == hex, "parse/write round-trip");
+		}
+		
+		decodeHex("a3626964187b646e616d6563616263646c6973749f01028203fb3ff8000000000000ff");
+		auto *root = doc.parse(CborWalker(bytes));
+		test(root && root->isMap() && root->size() == 3, "parsed map");
+		test(root->find("id")->asInt() == 123 && (*root)["name"]->utf8() == "abc", "find()");
+		test((*root)["name"]->bytes() == bytes.data() + 12, "strings aren't copied");
+		auto *list = root->find("list");
+		test(list->isArray() && list->size() == 3 && (*list)[1]->asInt() == 2 && (*list)[2]->isArray() && (*(*list)[2])[1]->asDouble() == 1.5, "indefinite array");
+		
+		// Edits
+		root->find("id")->setInt(-5);
+		list->remove((*list)[0]);
+		list->append(doc.newUtf8(std::string("added")));
+		root->remove(root->first()->next()->next()); // "name"
+		auto *sub = doc.newMap();
+		sub->add(doc.newInt(1), doc.newBool(true));
+		sub->add(doc.newInt(-2), doc.newNull());
+		root->add(doc.newUtf8("sub"), sub);
+		test(root->size() == 3 && !root->find("name") && root->find("sub")->find(-2)->isNull() && root->find("sub")->find(1)->asBool(), "edited map");
+		std::vector<unsigned char> edited;
+		signalsmith::cbor::CborWriter editedWriter(edited);
+		doc.write(editedWriter);
+		CborWalker editedRoot(edited);
+		test((int64_t)editedRoot["id"] == -5 && editedRoot["list"].length() == 3 && editedRoot["list"].enter().next(2).utf8() == "added", "edited document");
+		test(editedRoot["sub"].isMap() && editedRoot["sub"].length() == 2 && !editedRoot["name"].isUtf8(), "edited document (map)");
+		
+		// Indefinite strings are joined, and the document is independent of the source afterwards
+		decodeHex("7f626162616363646566ff");
+		root = doc.parse(CborWalker(bytes));
+		std::fill(bytes.begin(), bytes.end(), 0);
+		test(root->isUtf8() && root->utf8() == "abcdef", "indefinite string joined");
+		
+		// Lots of nodes, across several blocks
+		std::vector<unsigned char> big;
+		signalsmith::cbor::CborWriter bigWriter(big);
+		bigWriter.openArray(1000);
+		for (int i = 0; i < 1000; ++i) {
+			bigWriter.openMap(1);
+			bigWriter.addUtf8("k" + std::to_string(i));
+			bigWriter.addInt(i);
+		}
+		doc.clear();
+		root = doc.parse(CborWalker(big));
+		test(root && root->size() == 1000 && (*root)[999]->find("k999")->asInt() == 999, "multi-block parse");
+		test(writeHex(root).size() == big.size()*2, "multi-block write");
+		
+		const char *invalid[] = {"", "8301", "a1", "ff", "9f01", "a2010203", "1c", "7f01ff"};
+		for (auto hex : invalid) {
+			decodeHex(hex);
+			test(!doc.parse(CborWalker(bytes)) && doc.error(), "invalid input gives an error");
+		}
+		std::vector<unsigned char> deep(200, 0x81);
+		deep.push_back(0);
+		test(!doc.parse(CborWalker(deep)) && doc.error() == CborWalker::ERROR_TOO_DEEP, "too deep");
+	}
+
+	// Splicing edits into an encoded buffer
+	{
+		using signalsmith::cbor::CborWalker;
+		using signalsmith::cbor::CborSplice;
+		std::vector<unsigned char> edited;
+		auto raw = [](std::initializer_list<unsigned char> list){
+			return std::vector<unsigned char>(list);
+		};
+		
+		decodeHex("a3616183010203616261786163a1616401");
+		{
+			CborWalker root(bytes), list = root["a"];
+			CborSplice splice(bytes);
+			test(splice.replace(list.enter().next(), raw({0x19, 0x03, 0xe8})), "replace()");
+			test(splice.remove(root.enter().next(2)), "remove() map entry");
+			test(splice.insertBefore(list.enter(), raw({0xf5, 0xf4}), 2), "insertBefore()");
+			test(splice.append(root["c"], raw({0x61, 0x65, 0x02})), "append() map entry");
+			test(splice.apply(edited), "apply()");
+			test(encodeHex(edited) == "a2616185f5f4011903e8036163a2616401616502", "spliced output");
+			test(bytes[0] == 0xa3, "original unchanged");
+		}
+		
+		// Heads can change size
+		std::vector<unsigned char> longArray(24, 0);
+		longArray[0] = 0x97;
+		{
+			CborSplice splice(longArray);
+			splice.append(CborWalker(longArray), raw({0x18, 0x64}));
+			test(splice.apply(edited) && edited.size() == 27 && edited[0] == 0x98 && edited[1] == 24 && edited[25] == 0x18, "head grows");
+			splice.clear();
+			splice.remove(CborWalker(longArray).enter());
+			splice.remove(CborWalker(longArray).enter().next());
+			test(splice.apply(edited) && encodeHex(edited) == "95" + std::string(42, '0'), "two removals");
+		}
+		
+		// Indefinite-length containers don't need their heads changing
+		decodeHex("9f01ff");
+		{
+			CborSplice splice(bytes);
+			splice.append(CborWalker(bytes), raw({0x02}));
+			test(splice.apply(edited) && encodeHex(edited) == "9f0102ff", "append() indefinite array");
+		}
+		decodeHex("bf61610161629f02ffff");
+		{
+			CborSplice splice(bytes);
+			splice.remove(CborWalker(bytes).enter());
+			splice.append(CborWalker(bytes)["b"], raw({0x03}));
+			test(splice.apply(edited) && encodeHex(edited) == "bf61629f0203ffff", "edit indefinite map");
+		}
+		
+		// The top level is a sequence
+		decodeHex("010203");
+		{
+			CborSplice splice(bytes);
+			splice.remove(CborWalker(bytes).next());
+			splice.insertBefore(CborWalker(bytes), raw({0x00}));
+			test(splice.apply(edited) && encodeHex(edited) == "000103", "top-level sequence");
+		}
+		
+		// Tagged items keep their tags when replaced through a `TaggedCborWalker`, but are removed whole
+		decodeHex("82c11a514b67b001");
+		{
+			CborSplice splice(bytes);
+			signalsmith::cbor::TaggedCborWalker tagged = CborWalker(bytes).enter();
+			test(tagged.itemStart() == bytes.data() + 2, "tagged walker position");
+			splice.replace(tagged, raw({0x00}));
+			test(splice.apply(edited) && encodeHex(edited) == "82c10001", "replace tagged item");
+			splice.clear();
+			splice.remove(tagged);
+			test(splice.apply(edited) && encodeHex(edited) == "8101", "remove tagged item");
+		}
+		
+		// Edits which don't change any sizes can be written in place
+		decodeHex("a2616101616282f5f4");
+		{
+			CborSplice splice(bytes);
+			splice.replace(CborWalker(bytes)["a"], raw({0x17}));
+			splice.replace(CborWalker(bytes)["b"].enter(), raw({0xf6}));
+			test(splice.applyInPlace(bytes.data()) && encodeHex(bytes) == "a2616117616282f6f4", "applyInPlace()");
+			splice.clear();
+			splice.append(CborWalker(bytes)["b"], raw({0xf7}));
+			test(!splice.applyInPlace(bytes.data()) && encodeHex(bytes) == "a2616117616282f6f4", "applyInPlace() needs same-size edits");
+			test(splice.apply(edited) && encodeHex(edited) == "a2616117616283f6f4f7", "apply() after failed applyInPlace()");
+		}
+		
+		// Errors
+		decodeHex("a2616183010203616264494554");
+		{
+			CborSplice splice(bytes);
+			splice.remove(CborWalker(bytes)["a"]);
+			test(!splice.apply(edited) && splice.error() == CborWalker::ERROR_METHOD_TYPE_MISMATCH, "map values can't be removed");
+			splice.clear();
+			splice.replace(CborWalker(bytes)["a"], raw({0x00}));
+			splice.replace(CborWalker(bytes)["a"].enter(), raw({0x00}));
+			test(!splice.apply(edited) && splice.error() == CborWalker::ERROR_INVALID_VALUE, "overlapping edits");
+			splice.clear();
+			splice.replace(CborWalker(bytes.data() + 10, bytes.data() + bytes.size()), raw({0x00}));
+			test(!splice.apply(edited) && splice.error() == CborWalker::ERROR_NOT_FOUND, "edit inside a string");
+			splice.clear();
+			test(!splice.append(CborWalker(bytes)["b"], raw({0x00})) && splice.error() == CborWalker::ERROR_METHOD_TYPE_MISMATCH, "append() to a string");
+			std::vector<unsigned char> other(bytes);
+			splice.clear();
+			test(!splice.remove(CborWalker(other)) && splice.error() == CborWalker::ERROR_NOT_FOUND, "walker from another buffer");
+		}
+	}
+
+	// Record boundaries and parallel processing
+	{
+		using signalsmith::cbor::CborWalker;
+		signalsmith::cbor::CborRecords records;
+		
+		decodeHex("01a16161820203c11a514b67b05f4161ff9f80ff6161");
+		test(records.findSequence(bytes) && records.size() == 6, "findSequence()");
+		test((int)records[0] == 1 && records[1]["a"].isArray() && records[2].isTagged() && records[5].utf8() == "a", "sequence records");
+		test(records[4].next().atEnd(), "record walkers end with the record");
+		test(records.findArray(bytes.data() + 4, 3) && records.size() == 2 && (int)records[1] == 3, "findArray()");
+		decodeHex("9f0102a0ff00");
+		test(records.findArray(bytes) && records.size() == 3 && records[2].isMap(), "findArray() indefinite");
+		
+		const char *invalid[] = {"8201", "9f01", "5f01ff", "7f4100ff", "1c", "ff", "9f01ffff", "81ff", "bf01", "a201", "c1"};
+		for (auto hex : invalid) {
+			decodeHex(hex);
+			test(!records.findSequence(bytes) && records.error(), "invalid sequence");
+		}
+		decodeHex("01027f");
+		test(!records.findSequence(bytes) && records.error() == CborWalker::ERROR_END_OF_DATA && records.errorOffset() == 2 && records.size() == 0, "error offset");
+		decodeHex("a1");
+		test(!records.findArray(bytes) && records.error() == CborWalker::ERROR_METHOD_TYPE_MISMATCH, "findArray() needs an array");
+		
+		// Records agree with `.next()`
+		std::vector<unsigned char> sequence;
+		signalsmith::cbor::CborWriter writer(sequence);
+		writer.openArray(5000);
+		for (size_t i = 0; i < 5000; ++i) {
+			if (i%3 == 0) {
+				writer.openMap(2);
+				writer.addUtf8("id");
+				writer.addUInt(i);
+				writer.addUtf8("x");
+				writer.openArray();
+				writer.addTag(1);
+				writer.addFloat(i*0.5);
+				writer.close();
+			} else if (i%3 == 1) {
+				writer.addUtf8(std::string(i%40, 'x'));
+			} else {
+				writer.addUInt(i);
+			}
+		}
+		test(records.findArray(sequence) && records.size() == 5000, "large array");
+		CborWalker item = CborWalker(sequence).enter();
+		bool matching = true;
+		for (size_t i = 0; i < records.size(); ++i) {
+			matching = matching && records[i].itemStart() == item.itemStart();
+			++item;
+		}
+		test(matching, "records match next()");
+		
+		for (size_t threads : {1, 2, 3, 8, 64}) {
+			for (size_t perTask : {0, 1, 7, 10000}) {
+				std::vector<std::atomic<int>> visits(records.size());
+				std::atomic<uint64_t> total{0};
+				records.forEachParallel([&](const CborWalker &record, size_t index){
+					visits[index]++;
+					uint64_t value = record.isMap() ? (uint64_t)record["id"] : record.isUtf8() ? index : (uint64_t)record;
+					total += value;
+				}, threads, perTask);
+				bool once = true;
+				for (auto &v : visits) once = once && (v == 1);
+				test(once && total == 5000*4999/2, "forEachParallel() visits each record once");
+			}
+		}
+	}
+
+	// Memory-mapped files
+	{
+		using signalsmith::cbor::CborWalker;
+		using signalsmith::cbor::CborMappedFile;
+		std::vector<unsigned char> sequence;
+		signalsmith::cbor::CborWriter writer(sequence);
+		for (size_t i = 0; i < 20000; ++i) {
+			writer.openMap(2);
+			writer.addUtf8("id");
+			writer.addUInt(i);
+			writer.addUtf8("name");
+			writer.addUtf8("item-" + std::to_string(i));
+		}
+		{
+			std::ofstream file("mapped-file-test.cbor", std::ios::binary);
+			file.write((const char *)sequence.data(), sequence.size());
+		}
+		
+		CborMappedFile mapped("mapped-file-test.cbor");
+		test((bool)mapped && mapped.size() == sequence.size() && !std::memcmp(mapped.data(), sequence.data(), sequence.size()), "CborMappedFile");
+		test((uint64_t)mapped.walker().next(123)["id"] == 123, "mapped walker");
+		size_t count = 0;
+		uint64_t total = 0;
+		bool complete = mapped.forEachItem([&](const CborWalker &item){
+			total += (uint64_t)item["id"];
+			++count;
+		}, 4096);
+		test(complete && count == 20000 && total == 20000ull*19999/2, "forEachItem()");
+		mapped.advise(CborMappedFile::Access::random);
+		mapped.prefetch(mapped.data() + 5000, 100000);
+		signalsmith::cbor::CborRecords records;
+		test(records.findSequence(mapped.data(), mapped.size()) && records.size() == 20000, "CborRecords over a mapped file");
+		
+		mapped.close();
+		test(!mapped && mapped.size() == 0, "close()");
+		test(!mapped.open("does-not-exist.cbor") && mapped.error() != 0, "missing file");
+		{
+			std::ofstream file("mapped-file-empty.cbor", std::ios::binary);
+		}
+		test(mapped.open(std::string("mapped-file-empty.cbor")) && mapped.size() == 0 && mapped.walker().atEnd(), "empty file");
+		test(mapped.forEachItem([&](const CborWalker &){}), "forEachItem() on an empty file");
+		{
+			std::ofstream file("mapped-file-test.cbor", std::ios::binary);
+			file.write((const char *)sequence.data(), 100);
+		}
+		test(mapped.open("mapped-file-test.cbor") && mapped.size() == 100, "reopen");
+		count = 0;
+		complete = mapped.forEachItem([&](const CborWalker &){
+			++count;
+		});
+		test(!complete && count > 0, "forEachItem() on truncated data");
+		
+		auto openFile = [](const char *path){
+			return CborMappedFile(path);
+		};
+		CborMappedFile moved = openFile("mapped-file-test.cbor");
+		const unsigned char *movedData = moved.data();
+		test(moved && moved.size() == 100 && !std::memcmp(moved.data(), sequence.data(), 100), "CborMappedFile returned from a function");
+		mapped = std::move(moved);
+		test(mapped && !moved && mapped.data() == movedData && moved.data() == nullptr && (uint64_t)mapped.walker()["id"] == 0, "CborMappedFile move assignment");
+	}
+
+	// Sidecar index for CBOR Sequences
+	{
+		using signalsmith::cbor::CborWalker;
+		std::vector<unsigned char> sequence;
+		signalsmith::cbor::CborWriter writer(sequence);
+		constexpr size_t recordCount = 3000;
+		for (size_t i = 0; i < recordCount; ++i) {
+			writer.openMap(2);
+			writer.addUtf8("id");
+			writer.addUInt(i*2);
+			writer.addUtf8("name");
+			writer.addUtf8(std::string(i%50, 'x'));
+		}
+		signalsmith::cbor::CborRecords records;
+		records.findSequence(sequence);
+		
+		for (size_t stride : {1, 3, 64, 5000}) {
+			signalsmith::cbor::CborSequenceIndex index;
+			test(index.build(sequence, stride) && index.size() == recordCount && index.checkpoints() == (recordCount + stride - 1)/stride, "build()");
+			bool matching = true;
+			for (size_t i = 0; i < recordCount; i += 7) {
+				matching = matching && index.record(sequence, i).itemStart() == records[i].itemStart();
+			}
+			test(matching && index.record(sequence, recordCount - 1).itemStart() == records[recordCount - 1].itemStart(), "record()");
+			test(index.record(sequence, recordCount).atEnd(), "record() out of range");
+			
+			// Stored as CBOR, and read back
+			std::vector<unsigned char> stored;
+			signalsmith::cbor::CborWriter indexWriter(stored);
+			index.write(indexWriter);
+			if (stride == 1) test(stored.size() < recordCount*3, "delta-encoded offsets");
+			signalsmith::cbor::CborSequenceIndex loaded;
+			test(loaded.read(CborWalker(stored)) && loaded.size() == recordCount && loaded.recordsPerCheckpoint() == stride && loaded.indexedLength() == sequence.size(), "read()");
+			test((uint64_t)loaded.record(sequence, 1234)["id"] == 2468, "record() from loaded index");
+			test(loaded.record(sequence.data(), sequence.size() - 1, 5).atEnd(), "stale index");
+			
+			// Sorted by "id"
+			auto before = [](uint64_t id){
+				return [=](const CborWalker &record){
+					return (uint64_t)record["id"] < id;
+				};
+			};
+			test(index.lowerBound(sequence.data(), sequence.size(), before(0)) == 0, "lowerBound() first");
+			test(index.lowerBound(sequence.data(), sequence.size(), before(1001)) == 501, "lowerBound()");
+			test(index.lowerBound(sequence.data(), sequence.size(), before(1000)) == 500, "lowerBound() exact");
+			test(index.lowerBound(sequence.data(), sequence.size(), before(recordCount*2 + 5)) == recordCount, "lowerBound() past the end");
+			
+			std::vector<std::atomic<int>> visits(recordCount);
+			std::atomic<uint64_t> total{0};
+			test(index.forEachParallel(sequence.data(), sequence.size(), [&](const CborWalker &record, size_t i){
+				visits[i]++;
+				total += (uint64_t)record["id"];
+			}, 4), "forEachParallel()");
+			bool once = true;
+			for (auto &v : visits) once = once && (v == 1);
+			test(once && total == uint64_t(recordCount)*(recordCount - 1), "index forEachParallel() visits each record once");
+		}
+		
+		signalsmith::cbor::CborSequenceIndex index;
+		decodeHex("0102a1");
+		test(!index.build(bytes) && index.error() == CborWalker::ERROR_END_OF_DATA && index.size() == 0, "build() on invalid data");
+		const char *invalidIndex[] = {"a0", "a4000301010203038100", "a4000201010203038200", "a400020101020303820000", "a4000201000203038100", "a400020101020303820003"};
+		for (auto hex : invalidIndex) {
+			decodeHex(hex);
+			test(!index.read(CborWalker(bytes)) && index.error(), "invalid index");
+		}
+		decodeHex("a400020101020303820001");
+		test(index.read(CborWalker(bytes)) && index.size() == 2 && index.checkpointOffset(1) == 1, "minimal index");
+		// Corrupt indexes: more records than bytes (where the checkpoint count overflowed), a non-integer delta, and a first checkpoint which isn't the start
+		const char *corruptIndex[] = {"a4001bffffffffffffffff010202030380", "a40002010102030382f601", "a400020101020303820101"};
+		for (auto hex : corruptIndex) {
+			decodeHex(hex);
+			test(!index.read(CborWalker(bytes)) && index.error() && index.size() == 0, "corrupt index");
+			std::vector<unsigned char> data(3, 0);
+			test(index.record(data, 1000000).atEnd(), "corrupt index has no records");
+		}
+	}
+
+	// Path queries
+	{
+		using signalsmith::cbor::CborWalker;
+		using signalsmith::cbor::CborPath;
+		std::vector<unsigned char> events;
+		signalsmith::cbor::CborWriter writer(events);
+		writer.openMap(3);
+		writer.addUtf8("events");
+		writer.openArray(4);
+		for (int i = 0; i < 4; ++i) {
+			writer.openMap(2);
+			writer.addUtf8("type");
+			writer.addUtf8(i%2 ? "click" : "view");
+			writer.addUtf8("payload");
+			if (i == 2) writer.addTag(1234);
+			writer.openMap(2);
+			writer.addUtf8("id");
+			writer.addInt(100 + i);
+			writer.addInt(7); // integer key
+			writer.addUtf8("seven");
+		}
+		writer.addUtf8("a/b~c");
+		writer.addUtf8("escaped");
+		writer.addUtf8("list");
+		writer.openArray();
+		writer.addInt(1);
+		writer.openArray();
+		writer.addInt(2);
+		writer.close();
+		writer.close();
+		CborWalker root(events);
+		
+		auto ints = [&](const char *expression){
+			CborPath path(expression);
+			std::vector<int64_t> result;
+			path.forEach(root, [&](const CborWalker &match){
+				result.push_back((int64_t)match);
+			});
+			return result;
+		};
+		test(ints("$.events[*].payload.id") == std::vector<int64_t>({100, 101, 102, 103}), "wildcard path");
+		test(ints("$['events'][1][\"payload\"].id") == std::vector<int64_t>{101}, "bracketed keys");
+		test(ints("$.events[-1].payload.id") == std::vector<int64_t>{103}, "negative index");
+		test(ints("$.events[4].payload.id").empty() && ints("$.events[-5].payload.id").empty() && ints("$.nope[*]").empty(), "no matches");
+		test(ints("$..id") == std::vector<int64_t>({100, 101, 102, 103}), "descendant key");
+		test(ints("$.list[1][0]") == std::vector<int64_t>{2} && ints("$.list[-1]").empty(), "indefinite arrays");
+		test(ints("$.list..[0]") == std::vector<int64_t>({1, 2}), "descendant index");
+		test(ints("/events/2/payload/id") == std::vector<int64_t>{102}, "JSON Pointer");
+		test(CborPath("/a~1b~0c").first(root).utf8() == "escaped", "JSON Pointer escapes");
+		test(CborPath("/events/0/payload/7").first(root).utf8() == "seven" && CborPath("$.events[0].payload[7]").first(root).utf8() == "seven", "integer map keys");
+		test(CborPath("").first(root).isMap() && CborPath("$").first(root).isMap(), "whole document");
+		test(CborPath("$.events[2].payload").first(root).isTagged() && CborPath("$.events[2].payload").first(root).itemStart() == CborPath("$.events[2]").first(root)["payload"].itemStart(), "tagged matches keep their tags");
+		test(CborPath("$.events[*].type").all(root).size() == 4 && CborPath("$.events.*.type").all(root).size() == 4, "all()");
+		test(CborPath("$.events[*].type").first(root).utf8() == "view", "first()");
+		test(CborPath("$.nope").first(root).error() == CborWalker::ERROR_NOT_FOUND, "first() with no match");
+		
+		const char *invalid[] = {"events", "$.", "$[", "$['a", "$[a]", "$.a[1", "$.[0]", "/a~2", "$..", "$[99999999999999999999]"};
+		for (auto expression : invalid) {
+			CborPath path(expression);
+			test(!path && path.forEach(root, [](const CborWalker &){}) == 0, std::string("invalid path: ") + expression);
+		}
+		test(CborPath("$.a[").errorOffset() == 4, "errorOffset()");
+	}
+
+	// Projections
+	{
+		using signalsmith::cbor::CborWalker;
+		using signalsmith::cbor::CborProjection;
+		std::vector<unsigned char> record;
+		signalsmith::cbor::CborWriter writer(record);
+		writer.openMap();
+		writer.addUtf8("id");
+		writer.addInt(42);
+		writer.addUtf8("user");
+		writer.addTag(1234);
+		writer.openMap(3);
+		writer.addUtf8("name");
+		writer.addUtf8("Ada");
+		writer.addInt(7);
+		writer.addUtf8("seven");
+		writer.addUtf8("0");
+		writer.addUtf8("zero");
+		writer.addUtf8("tags");
+		writer.openArray(3);
+		writer.addUtf8("a");
+		writer.addUtf8("b");
+		writer.addUtf8("c");
+		writer.addUtf8("id");
+		writer.addInt(43); // duplicate key
+		writer.addUtf8("later");
+		writer.addBool(true);
+		writer.close();
+		CborWalker root(record);
+
+		CborProjection projection{"$.id", "$.user.name", "/user/7", "$.tags[-1]", "$.tags[0]", "$.missing", "$.user", "$.user['0']", "/tags/1"};
+		test(projection && projection.size() == 9, "projection compiles");
+		std::vector<CborWalker> slots;
+		test(projection.extract(root, slots) == 8 && slots.size() == 9, "projection count");
+		test((int64_t)slots[0] == 42, "first duplicate key wins");
+		test(slots[1].utf8() == "Ada" && slots[2].utf8() == "seven" && slots[7].utf8() == "zero", "nested projection");
+		test(slots[3].utf8() == "c" && slots[4].utf8() == "a" && slots[8].utf8() == "b", "projected array items");
+		test(slots[5].error() == CborWalker::ERROR_NOT_FOUND, "missing projection");
+		test(slots[6].isTagged(), "projected matches keep their tags");
+
+		// Stops once everything is found, so the truncated end isn't read
+		std::vector<unsigned char> truncated(record.begin(), record.end() - 3);
+		CborProjection early{"$.id", "$.user.name"};
+		CborWalker pair[2];
+		test(early.extract(CborWalker(truncated), pair) == 2 && pair[1].utf8() == "Ada", "projection stops early");
+
+		// "/0" is a text key or an index, but "['0']" is only a text key
+		CborProjection pointer{"$['0']", "/0", "$[0]"};
+		std::vector<unsigned char> list = {0x81, 0x05};
+		test(pointer.extract(CborWalker(list), slots) == 2 && slots[0].error() && (int)slots[1] == 5 && (int)slots[2] == 5, "JSON Pointer indices in projections");
+		// Paths of different kinds don't share trie nodes, so results don't depend on the other paths
+		CborProjection mixed{"$['0']", "/0", "$['0'].y", "$[0].y"};
+		std::vector<unsigned char> arrayRecord = {0x81, 0xA1, 0x61, 'y', 0x01}, mapRecord = {0xA1, 0x61, '0', 0xA1, 0x61, 'y', 0x02};
+		test(mixed.extract(CborWalker(arrayRecord), slots) == 2 && slots[0].error() && slots[1].isMap() && slots[2].error() && (int)slots[3] == 1, "mixed path kinds on an array");
+		test(mixed.extract(CborWalker(mapRecord), slots) == 3 && slots[0].isMap() && slots[1].isMap() && (int)slots[2] == 2 && slots[3].error(), "mixed path kinds on a map");
+
+		test(!CborProjection{"$.a", "$.b[*]"} && !CborProjection{"$..a"} && !CborProjection{"nope"}, "invalid projections");
+		CborProjection invalid{"$..a"};
+		test(invalid.extract(root, slots) == 0 && slots.size() == 1 && slots[0].error() == CborWalker::ERROR_NOT_FOUND, "invalid projection finds nothing");
+	}
+
+	// Streaming parser
+	{
+		using signalsmith::cbor::CborWalker;
+		std::vector<unsigned char> sequence;
+		{
+			signalsmith::cbor::CborWriter writer(sequence);
+			writeExampleDocument(writer);
+			writer.addInt(5);
+			writer.addUtf8(std::string(300, 'x'));
+			writer.openArray(0);
+			writer.addTag(1);
+			writer.addTag(2);
+			writer.addUInt(4294967296ull);
+			writer.openMap();
+			writer.addUtf8("a");
+			writer.openBytes();
+			writer.addBytes("abc", 3);
+			writer.addBytes("", 0);
+			writer.close();
+			writer.close();
+			writer.addFloat(1.5);
+		}
+		// Expected item boundaries
+		std::vector<std::vector<unsigned char>> expected;
+		CborWalker walker(sequence);
+		while (!walker.error()) {
+			CborWalker next = walker.next();
+			expected.emplace_back(walker.itemStart(), next.itemStart());
+			walker = next;
+		}
+		test(expected.size() == 21, "stream parser test items");
+
+		for (size_t chunkSize : {1, 2, 3, 7, 64, 100000}) {
+			signalsmith::cbor::CborStreamParser parser;
+			std::vector<std::vector<unsigned char>> items;
+			bool ok = true;
+			for (size_t start = 0; start < sequence.size(); start += chunkSize) {
+				size_t length = std::min(chunkSize, sequence.size() - start);
+				ok = ok && parser.bytesNeeded() <= sequence.size() - start;
+				ok = ok && parser.push(sequence.data() + start, length, [&](const CborWalker &item){
+					CborWalker next = item.next();
+					ok = ok && next.atEnd();
+					items.emplace_back(item.itemStart(), next.itemStart());
+				});
+			}
+			std::string name = "stream parser: chunk size " + std::to_string(chunkSize);
+			test(ok && !parser.error(), name);
+			test(items == expected, name + " items");
+			test(!parser.partial() && parser.bytesNeeded() == 1, name + " ends between items");
+		}
+
+		auto streamHex = [&](const char *hex, size_t maxItemBytes=~size_t(0), size_t maxDepth=CBOR_WALKER_MAX_DEPTH) {
+			decodeHex(hex);
+			signalsmith::cbor::CborStreamParser parser(maxItemBytes, maxDepth);
+			size_t count = 0;
+			for (unsigned char byte : bytes) {
+				parser.push(&byte, 1, [&](const CborWalker &){++count;});
+			}
+			return parser.error() ? parser.error() + 1000 : count;
+		};
+		test(streamHex("0x9f018202039f0405ffff") == 1, "stream indefinite array");
+		test(streamHex("0xbf61610161629f0203ffff01") == 2, "stream indefinite map");
+		test(streamHex("0x5f42010243030405ff") == 1, "stream indefinite bytes");
+		test(streamHex("0xff") == 1000 + CborWalker::ERROR_INVALID_VALUE, "stream: break outside indefinite container");
+		test(streamHex("0xbf01ff") == 1000 + CborWalker::ERROR_INVALID_VALUE, "stream: break after indefinite map key");
+		test(streamHex("0x5f4201026161ff") == 1000 + CborWalker::ERROR_INCONSISTENT_INDEFINITE, "stream: mixed chunk types");
+		test(streamHex("0x1c") == 1000 + CborWalker::ERROR_INVALID_ADDITIONAL, "stream: reserved additional info");
+		test(streamHex("0xf810") == 1000 + CborWalker::ERROR_INVALID_VALUE, "stream: two-byte simple value < 32");
+		test(streamHex("0x818181818100", ~size_t(0), 4) == 1000 + CborWalker::ERROR_TOO_DEEP, "stream: maxDepth");
+		test(streamHex("0x818181818100", ~size_t(0), 5) == 1, "stream: maxDepth (just enough)");
+		test(streamHex("0x5a00010000", 1000) == 1000 + CborWalker::ERROR_TOO_LARGE, "stream: string longer than maxItemBytes");
+		test(streamHex("0x830102038301020383010203", 4) == 3, "stream: items within maxItemBytes");
+		test(streamHex("0x830102038301020383010203", 3) == 1000 + CborWalker::ERROR_TOO_LARGE, "stream: maxItemBytes");
+
+		signalsmith::cbor::CborStreamParser parser;
+		auto ignore = [](const CborWalker &){};
+		decodeHex("0x83015a00000100");
+		parser.push(bytes, ignore);
+		test(parser.partial() && parser.bytesNeeded() == 256 + 1, "bytesNeeded() in string");
+		parser.reset();
+		decodeHex("0xa201");
+		parser.push(bytes, ignore);
+		test(parser.bytesNeeded() == 3, "bytesNeeded() in map");
+		decodeHex("0x1a01");
+		parser.reset();
+		parser.push(bytes, ignore);
+		test(parser.bytesNeeded() == 3, "bytesNeeded() in head");
+	}
+
+	// Map lookup
+	decodeHex("0xa3616101616282020361630a");
+	test((int)cbor.find("a") == 1, "find(\"a\")");
+	test(cbor["b"].isArray(), "[\"b\"] is array");
+	test((int)cbor[std::string("c")] == 10, "[std::string(\"c\")]");
+	test(cbor.find("d").error() == signalsmith::cbor::CborWalker::ERROR_NOT_FOUND, "missing key");
+	test(cbor.find(1).error() == signalsmith::cbor::CborWalker::ERROR_NOT_FOUND, "missing int key");
+	test(cbor.enter().find("a").error() == signalsmith::cbor::CborWalker::ERROR_METHOD_TYPE_MISMATCH, "not a map");
+
+	decodeHex("0xbf0161612061626163f5ff");
+	test(cbor.find(1).utf8() == "a", "find(1) in indefinite map");
+	test(cbor.find(-1).utf8() == "b", "find(-1)");
+	test(cbor.find((uint64_t)1).utf8() == "a", "find((uint64_t)1)");
+	test((bool)cbor["c"], "[\"c\"] in indefinite map");
+	test(taggedCbor["c"].isBool(), "TaggedCborWalker lookup");
+	{
+		signalsmith::cbor::CborMapIndex index(cbor);
+		test(index.size() == 3, "indexed 3 keys");
+		test(index.find(1).utf8() == "a", "index.find(1)");
+		test(index.find(-1).utf8() == "b", "index.find(-1)");
+		test(index.find(0).error() == signalsmith::cbor::CborWalker::ERROR_NOT_FOUND, "index.find(0) missing");
+		test((bool)index["c"], "index[\"c\"]");
+		test(index.find("a").error(), "index.find(\"a\") missing");
+	}
+	{
+		std::vector<unsigned char> mapBytes;
+		signalsmith::cbor::CborWriter mapWriter(mapBytes);
+		mapWriter.openMap(500);
+		for (int i = 0; i < 500; ++i) {
+			mapWriter.addUtf8("key" + std::to_string(i));
+			mapWriter.addInt(i*3);
+		}
+		signalsmith::cbor::CborWalker map(mapBytes);
+		signalsmith::cbor::CborMapIndex index;
+		test(index.build(map).atEnd(), "build() returns next item");
+		test(index.size() == 500, "indexed 500 keys");
+		bool allFound = true;
+		for (int i = 0; i < 500; ++i) {
+			std::string key = "key" + std::to_string(i);
+			allFound = allFound && (int)index[key] == i*3 && (int)map[key] == i*3;
+		}
+		test(allFound, "all keys found");
+		test(index["key500"].error() == signalsmith::cbor::CborWalker::ERROR_NOT_FOUND, "key500 missing");
+	}
+
 	// Check with https://geraintluff.github.io/cbor-debug/ - surround with 0x9F / 0xFF so it shows the sequence, and also checks it's closed properly
 	// It doesn't follow the floating-point ones at the end - those were copied from https://evanw.github.io/float-toy/
 	decodeHex(
@@ -670,6 +1920,278 @@ int main() {
 	}
 	test(true, "hell yeah");
 
+	{
+		signalsmith::cbor::CborWriterChunked chunkedWriter(16);
+		writeExampleDocument(chunkedWriter);
+		test(chunkedWriter.size() == writeBytes.size(), "CborWriterChunked size");
+		test(chunkedWriter.toVector() == writeBytes, "CborWriterChunked output matches");
+		size_t blockCount = 0;
+		chunkedWriter.forEachBlock([&](const unsigned char *, size_t){++blockCount;});
+		test(blockCount > 1, "CborWriterChunked used multiple blocks");
+		chunkedWriter.clear();
+		test(chunkedWriter.size() == 0, "CborWriterChunked clear()");
+		writeExampleDocument(chunkedWriter);
+		test(chunkedWriter.toVector() == writeBytes, "CborWriterChunked output matches after clear()");
+
+		std::ostringstream stringStream;
+		{
+			signalsmith::cbor::CborWriterBufferedStream bufferedWriter(stringStream, 16);
+			writeExampleDocument(bufferedWriter);
+		}
+		std::string streamed = stringStream.str();
+		test(std::vector<unsigned char>(streamed.begin(), streamed.end()) == writeBytes, "CborWriterBufferedStream output matches");
+		
+		unsigned char fixedBuffer[256];
+		signalsmith::cbor::CborWriterFixed fixedWriter(fixedBuffer);
+		writeExampleDocument(fixedWriter);
+		test(!fixedWriter.overflow(), "CborWriterFixed fits");
+		test(fixedWriter.size() == writeBytes.size() && fixedWriter.bytesNeeded() == writeBytes.size(), "CborWriterFixed size");
+		test(std::vector<unsigned char>(fixedWriter.data(), fixedWriter.data() + fixedWriter.size()) == writeBytes, "CborWriterFixed output matches");
+		fixedWriter.reset(fixedBuffer, 20);
+		writeExampleDocument(fixedWriter);
+		test(fixedWriter.overflow(), "CborWriterFixed overflow");
+		test(fixedWriter.size() <= 20, "CborWriterFixed didn't write past the end");
+		test(std::equal(fixedBuffer, fixedBuffer + fixedWriter.size(), writeBytes.begin()), "CborWriterFixed wrote a prefix");
+		test(fixedWriter.bytesNeeded() == writeBytes.size(), "CborWriterFixed reports bytes needed");
+		fixedWriter.reset();
+		fixedWriter.addInt(5);
+		test(!fixedWriter.overflow() && fixedWriter.size() == 1, "CborWriterFixed reset()");
+
+		std::vector<unsigned char> headBytes;
+		signalsmith::cbor::CborWriter headWriter(headBytes, 64);
+		test(headBytes.capacity() >= 64, "CborWriter reserves");
+		headWriter.addUInt(23);
+		headWriter.addUInt(24);
+		headWriter.addInt(-257);
+		headWriter.addUInt(65536);
+		headWriter.addUInt(4294967296ull);
+		std::vector<unsigned char> expectedHeads = {0x17, 0x18, 0x18, 0x39, 0x01, 0x00, 0x1A, 0x00, 0x01, 0x00, 0x00, 0x1B, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00};
+		test(headBytes == expectedHeads, "head encodings");
+
+		// Patched definite lengths match writing the count up-front, except that a count which fits the reserved head keeps its width
+		for (size_t count : {0, 5, 23, 24, 300, 70000}) {
+			for (size_t expected : {0, 300}) {
+				std::vector<unsigned char> definiteBytes, patchedBytes;
+				signalsmith::cbor::CborWriter definiteWriter(definiteBytes), patchedWriter(patchedBytes);
+				definiteWriter.addInt(1);
+				definiteWriter.openMap(1);
+				definiteWriter.addUtf8("items");
+				definiteWriter.openArray(count);
+				for (size_t i = 0; i < count; ++i) definiteWriter.addInt(i);
+				definiteWriter.addInt(2);
+				patchedWriter.addInt(1);
+				auto mapHead = patchedWriter.openMapPatchable();
+				patchedWriter.addUtf8("items");
+				auto arrayHead = patchedWriter.openArrayPatchable(expected);
+				for (size_t i = 0; i < count; ++i) patchedWriter.addInt(i);
+				patchedWriter.close(arrayHead, count);
+				patchedWriter.close(mapHead, 1);
+				patchedWriter.addInt(2);
+				size_t minimalHead = (count < 24) ? 1 : (count < 256) ? 2 : (count < 65536) ? 3 : 5, reservedHead = expected ? 3 : 1;
+				std::vector<unsigned char> expectedBytes = definiteBytes;
+				if (reservedHead > minimalHead) {
+					size_t headPosition = 8; // after `1`, the map head and "items"
+					unsigned char wideHead[3] = {0x99, (unsigned char)(count>>8), (unsigned char)count};
+					expectedBytes.erase(expectedBytes.begin() + headPosition, expectedBytes.begin() + headPosition + minimalHead);
+					expectedBytes.insert(expectedBytes.begin() + headPosition, wideHead, wideHead + 3);
+				}
+				test(patchedBytes == expectedBytes, "patched length: " + std::to_string(count) + " items, expecting " + std::to_string(expected));
+				test((uint64_t)signalsmith::cbor::CborWalker(patchedBytes).next()["items"].length() == count, "patched length decodes");
+				
+				unsigned char patchedBuffer[256];
+				signalsmith::cbor::CborWriterFixed patchedFixed(patchedBuffer);
+				auto fixedHead = patchedFixed.openArrayPatchable(expected);
+				for (size_t i = 0; i < count; ++i) patchedFixed.addInt(i%24);
+				patchedFixed.close(fixedHead, count);
+				signalsmith::cbor::CborWalker patchedArray(patchedBuffer, patchedBuffer + patchedFixed.size());
+				bool fits = (count + 3 <= sizeof(patchedBuffer));
+				test(patchedFixed.overflow() != fits, "CborWriterFixed patched length overflow");
+				test(patchedFixed.bytesNeeded() == count + std::max(minimalHead, reservedHead), "CborWriterFixed patched length bytes needed");
+				test(!fits || (patchedArray.isArray() && patchedArray.hasLength() && patchedArray.length() == count && patchedArray.next().atEnd()), "CborWriterFixed patched length");
+			}
+		}
+	}
+
+	for (size_t length : {0, 1, 7, 37, 1000}) {
+		for (bool bigEndian : {false, true}) {
+			std::string name = "typed array round-trip: length " + std::to_string(length) + (bigEndian ? " big-endian" : " little-endian");
+			test(typedArrayRoundTrip<uint8_t>(length, bigEndian), name + " uint8");
+			test(typedArrayRoundTrip<int8_t>(length, bigEndian), name + " int8");
+			test(typedArrayRoundTrip<uint16_t>(length, bigEndian), name + " uint16");
+			test(typedArrayRoundTrip<int16_t>(length, bigEndian), name + " int16");
+			test(typedArrayRoundTrip<uint32_t>(length, bigEndian), name + " uint32");
+			test(typedArrayRoundTrip<int32_t>(length, bigEndian), name + " int32");
+			test(typedArrayRoundTrip<uint64_t>(length, bigEndian), name + " uint64");
+			test(typedArrayRoundTrip<int64_t>(length, bigEndian), name + " int64");
+			test(typedArrayRoundTrip<float>(length, bigEndian), name + " float");
+			test(typedArrayRoundTrip<double>(length, bigEndian), name + " double");
+			if (length) {
+				test(typedArrayRoundTrip<int8_t>(length, bigEndian, length/2), name + " int8 with offset");
+				test(typedArrayRoundTrip<int32_t>(length, bigEndian, length/2), name + " int32 with offset");
+				test(typedArrayRoundTrip<double>(length, bigEndian, length - 1), name + " double with offset");
+			}
+		}
+	}
+
+	// Half-precision floats
+	{
+		using signalsmith::cbor::Float16;
+		bool allRoundTrip = true, allMatchDouble = true;
+		for (uint32_t h = 0; h < 65536; ++h) {
+			float f = Float16::toFloat(h);
+			if (f != f) {
+				allRoundTrip = allRoundTrip && (Float16::fromFloat(f)&0x7E00) == 0x7E00;
+				continue;
+			}
+			allRoundTrip = allRoundTrip && Float16::fromFloat(f) == h && Float16::fromDouble(f) == h;
+			double nextUp = Float16::toFloat(h + 1); // halfway to the next value (within the same sign)
+			if ((h&0x7FFF) < 0x7C00 && nextUp == nextUp) {
+				double halfway = (f + nextUp)*0.5;
+				uint16_t even = (h&1) ? h + 1 : h;
+				allMatchDouble = allMatchDouble && Float16::fromDouble(halfway) == even && Float16::fromFloat(float(halfway)) == even;
+			}
+		}
+		test(allRoundTrip, "all half-floats round-trip");
+		test(allMatchDouble, "half-float ties round to even");
+		test(Float16::fromFloat(65504) == 0x7BFF && Float16::fromFloat(65519.99f) == 0x7BFF && Float16::fromFloat(65520) == 0x7C00, "half-float overflow");
+		test(Float16::fromFloat(-1e10f) == 0xFC00 && Float16::fromDouble(1e300) == 0x7C00, "half-float infinities");
+		test(Float16::fromFloat(1e-10f) == 0 && Float16::fromDouble(-1e-10) == 0x8000, "half-float underflow");
+		test(Float16::fromDouble(1.0 + 1.0/2048 + 1e-12) == 0x3C01, "half-float from double doesn't double-round");
+		test(Float16::bfloat16ToFloat(Float16::bfloat16FromFloat(1.5f)) == 1.5f && Float16::bfloat16FromFloat(1.00390625f) == 0x3F80 && Float16::bfloat16FromFloat(1.01171875f) == 0x3F82, "bfloat16");
+
+		decodeHex("f97bff");
+		test(cbor.isFloat() && (float)cbor == 65504, "half-float 65504");
+		decodeHex("f90001");
+		test((double)cbor == 5.960464477539063e-8, "half-float subnormal");
+		decodeHex("f9fc00");
+		test((double)cbor == -INFINITY, "half-float -Infinity");
+
+		for (size_t length : {0, 1, 7, 37, 3000}) {
+			std::vector<float> floats(length);
+			std::vector<double> doubles(length);
+			for (size_t i = 0; i < length; ++i) {
+				doubles[i] = std::ldexp(double(i*37%101) - 50, int(i%40) - 24);
+				floats[i] = float(doubles[i]);
+			}
+			for (bool bigEndian : {false, true}) {
+				std::string name = "half-float typed array: length " + std::to_string(length) + (bigEndian ? " big-endian" : " little-endian");
+				std::vector<unsigned char> halfBytes;
+				signalsmith::cbor::CborWriter halfWriter(halfBytes);
+				halfWriter.addTypedArrayFloat16(floats.data(), length, bigEndian);
+				halfWriter.addTypedArrayFloat16(doubles.data(), length, bigEndian);
+				
+				signalsmith::cbor::TaggedCborWalker fromFloats(halfBytes);
+				test(fromFloats.isTypedArray() && fromFloats.tag(0) == (bigEndian ? 80 : 84) && fromFloats.typedArrayLength() == length, name);
+				std::vector<float> readFloats(length);
+				std::vector<double> readDoubles(length);
+				test(fromFloats.readTypedArray(readFloats) == length, name + " read");
+				bool allMatch = true;
+				for (size_t i = 0; i < length; ++i) {
+					allMatch = allMatch && Float16::fromFloat(readFloats[i]) == Float16::fromFloat(floats[i]);
+				}
+				test(allMatch, name + " values");
+				if (length) {
+					test(fromFloats.readTypedArray(readDoubles.data(), length/2, length) == length - length/2, name + " read (offset, double)");
+					allMatch = true;
+					for (size_t i = 0; i < length - length/2; ++i) {
+						allMatch = allMatch && readDoubles[i] == readFloats[i + length/2];
+					}
+					test(allMatch, name + " offset values");
+				}
+				
+				signalsmith::cbor::TaggedCborWalker fromDoubles = fromFloats.next();
+				test(fromDoubles.length() == fromFloats.length() && fromDoubles.readTypedArray(readDoubles) == length, name + " (from double)");
+			}
+		}
+	}
+
+	// Shortest-form floats (examples from RFC 8949 Appendix A)
+	{
+		auto shortestHex = [](double v) {
+			std::vector<unsigned char> floatBytes;
+			signalsmith::cbor::CborWriter floatWriter(floatBytes);
+			floatWriter.shortestFloats = true;
+			floatWriter.addFloat(v);
+			std::string hex;
+			for (unsigned char b : floatBytes) {
+				hex += "0123456789abcdef"[b>>4];
+				hex += "0123456789abcdef"[b&15];
+			}
+			return hex;
+		};
+		test(shortestHex(0.0) == "f90000", "shortest 0.0");
+		test(shortestHex(-0.0) == "f98000", "shortest -0.0");
+		test(shortestHex(1.0) == "f93c00", "shortest 1.0");
+		test(shortestHex(1.1) == "fb3ff199999999999a", "shortest 1.1");
+		test(shortestHex(1.5) == "f93e00", "shortest 1.5");
+		test(shortestHex(65504.0) == "f97bff", "shortest 65504.0");
+		test(shortestHex(100000.0) == "fa47c35000", "shortest 100000.0");
+		test(shortestHex(3.4028234663852886e+38) == "fa7f7fffff", "shortest 3.4028234663852886e+38");
+		test(shortestHex(1.0e+300) == "fb7e37e43c8800759c", "shortest 1.0e+300");
+		test(shortestHex(5.960464477539063e-8) == "f90001", "shortest 5.960464477539063e-8");
+		test(shortestHex(0.00006103515625) == "f90400", "shortest 0.00006103515625");
+		test(shortestHex(-4.0) == "f9c400", "shortest -4.0");
+		test(shortestHex(-4.1) == "fbc010666666666666", "shortest -4.1");
+		test(shortestHex(INFINITY) == "f97c00", "shortest Infinity");
+		test(shortestHex(NAN) == "f97e00", "shortest NaN");
+		test(shortestHex(-INFINITY) == "f9fc00", "shortest -Infinity");
+		test(shortestHex(2.98023223876953125e-8) == "fa33000000", "shortest (below half-float subnormals)");
+		test(shortestHex(1.401298464324817e-45) == "fa00000001", "shortest (float subnormal)");
+		test(shortestHex(65536.0) == "fa47800000", "shortest (above half-float range)");
+		test(shortestHex(1.00048828125) == "fa3f801000", "shortest (too precise for half-float)");
+		test(shortestHex(4.9406564584124654e-324) == "fb0000000000000001", "shortest (double subnormal)");
+
+		// Every half-float is written as a half-float, and reads back the same
+		bool allShortest = true;
+		for (uint32_t h = 0; h < 65536; ++h) {
+			double v = signalsmith::cbor::Float16::toFloat(h);
+			std::vector<unsigned char> floatBytes;
+			signalsmith::cbor::CborWriter floatWriter(floatBytes);
+			floatWriter.shortestFloats = true;
+			floatWriter.addFloat(v);
+			floatWriter.addFloat(float(v));
+			signalsmith::cbor::CborWalker walker(floatBytes);
+			allShortest = allShortest && floatBytes.size() == 6 && floatBytes[0] == 0xF9 && floatBytes[3] == 0xF9;
+			allShortest = allShortest && (v != v || ((double)walker == v && (double)walker.next() == v));
+		}
+		test(allShortest, "all half-floats written shortest");
+		
+		std::vector<unsigned char> floatBytes;
+		signalsmith::cbor::CborWriter floatWriter(floatBytes);
+		floatWriter.addFloat(1.5);
+		floatWriter.addFloat(1.5f);
+		test(floatBytes.size() == 14, "shortest floats are opt-in");
+	}
+
+	// Aligned typed arrays and zero-copy views
+	for (size_t leading = 0; leading < 20; ++leading) {
+		double doubles[5] = {1.5, -2.25, 1e100, 0, -1e-100};
+		std::vector<unsigned char> alignedBytes;
+		signalsmith::cbor::CborWriter alignedWriter(alignedBytes);
+		for (size_t i = 0; i < leading; ++i) alignedWriter.addInt(i);
+		test(alignedWriter.addTypedArrayAligned(doubles, 5, false, 16), "addTypedArrayAligned()");
+		alignedWriter.addTypedArrayAligned(doubles, 5, true);
+		test((bool)signalsmith::cbor::validate(alignedBytes, {256, ~uint64_t(0), true}), "aligned output is valid CBOR");
+		
+		signalsmith::cbor::TaggedCborWalker item = signalsmith::cbor::CborWalker(alignedBytes).next(leading);
+		test(item.isTypedArrayOf<double>() && !item.isTypedArrayOf<float>(), "isTypedArrayOf<double>()");
+		test(item.typedArrayView<float>().empty(), "mismatched type gives empty view");
+		auto view = item.typedArrayView<double>();
+		test(view.size() == 5 && view.direct(), "direct view");
+		test(((item.bytes() - alignedBytes.data())%16) == 0, "payload is 16-byte aligned");
+		test(view.data() && view.data()[2] == 1e100, "view.data()");
+		
+		item = item.next();
+		auto swappedView = item.typedArrayView<double>();
+		test(!swappedView.direct() && !swappedView.data(), "big-endian view isn't direct");
+		size_t i = 0;
+		for (double v : swappedView) {
+			test(v == doubles[i++], "byte-swapped view value");
+		}
+		double copied[5];
+		test(swappedView.copyTo(copied, 1) == 4 && copied[0] == doubles[1] && copied[3] == doubles[4], "view.copyTo()");
+	}
+
 	std::cout << "CborWriterStream:\n";
 	signalsmith::cbor::CborWriterStream writerStream{std::cout};
 	writeExampleDocument(writerStream);